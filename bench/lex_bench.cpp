@@ -0,0 +1,83 @@
+#include "../src/core/lex.h"
+#include "../src/utils/simd_scan.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+/*
+ Highlighting throughput on generated code with very long lines.
+ Usage: lex_bench [line_length] [iterations]
+*/
+
+namespace {
+
+std::string generated_line(const std::size_t length) {
+    static const std::string pieces[] = {
+        "auto value_", " = compute_checksum(buffer_", ", 0x1F2E3D4C);",
+        "    ", "/* inline note */", "std::size_t", " \"quoted \\\"text\\\"\"",
+        " + 12345.678e-3", " && other_identifier_name", "\t",
+    };
+    std::string line;
+    for (std::size_t i = 0; line.size() < length; ++i) {
+        line += pieces[i % std::size(pieces)];
+    }
+    line.resize(length);
+    return line;
+}
+
+template <typename Fn>
+double mb_per_sec(const std::size_t bytes, const std::size_t iterations,
+                  Fn fn) {
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        fn();
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return static_cast<double>(bytes * iterations) / elapsed.count() / 1e6;
+}
+
+} // namespace
+
+int main(const int argc, char* argv[]) {
+    const std::size_t length = argc > 1 ? std::stoul(argv[1]) : 10000;
+    const std::size_t iterations = argc > 2 ? std::stoul(argv[2]) : 2000;
+
+    const std::string line = generated_line(length);
+    const std::string idents(length, 'a');
+    const std::string spaces(length, ' ');
+    const char* begin = idents.data();
+    const char* end = begin + idents.size();
+    const auto& lang = lex::language_for("bench.cpp");
+
+    volatile std::size_t sink = 0;
+    std::printf("backend: %s, line length: %zu\n", scan::backend(), length);
+
+    std::printf("skip_ident  %-6s %10.1f MB/s\n", scan::backend(),
+                mb_per_sec(length, iterations, [&] {
+                    sink = sink + (scan::skip_ident(begin, end) - begin);
+                }));
+    std::printf("skip_ident  %-6s %10.1f MB/s\n", "scalar",
+                mb_per_sec(length, iterations, [&] {
+                    sink = sink + (scan::scalar::skip_ident(begin, end) - begin);
+                }));
+    std::printf("skip_space  %-6s %10.1f MB/s\n", scan::backend(),
+                mb_per_sec(length, iterations, [&] {
+                    sink = sink + (scan::skip_space(spaces.data(),
+                                                    spaces.data() + length) -
+                                   spaces.data());
+                }));
+    std::printf("tokenize           %10.1f MB/s\n",
+                mb_per_sec(length, iterations, [&] {
+                    auto state = lex::LineState::Normal;
+                    sink = sink + lex::tokenize(line, lang, state).size();
+                }));
+    std::printf("highlight_line     %10.1f MB/s\n",
+                mb_per_sec(length, iterations, [&] {
+                    lex::highlight_line(line, lang, lex::LineState::Normal,
+                                        [&](int, TokenType type, char) {
+                                            sink = sink + static_cast<int>(type);
+                                        });
+                }));
+    return 0;
+}
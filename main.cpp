@@ -1,12 +1,15 @@
 #include "src/core/editor.h"
 #include <iostream>
+#include <string_view>
  
 int main(const int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <filename>\n";
+    // -R: view the file read-only, mapped instead of loaded
+    const bool read_only = argc > 1 && std::string_view(argv[1]) == "-R";
+    if (argc < (read_only ? 3 : 2)) {
+        std::cerr << "Usage: " << argv[0] << " [-R] <filename>\n";
         return 1;
     }
-    Editor editor(argv[1]);
+    Editor editor(argv[read_only ? 2 : 1], read_only);
     editor.run();
 
     return 0;
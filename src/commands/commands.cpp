@@ -1,14 +1,43 @@
 #include "commands.h"
 #include "../core/editor.h"
+#include <algorithm>
+#include <cctype>
 #include <functional>
+#include <string>
+#include <vector>
 
 namespace Command {
 
+namespace {
+
+// splits on unescaped `delim`; an escaped delimiter loses its backslash,
+// every other escape is left for the regex / replacement
+std::vector<std::string> split_fields(const std::string_view text,
+                                      const char delim) {
+    std::vector<std::string> fields(1);
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\\' && i + 1 < text.size()) {
+            if (text[i + 1] != delim) {
+                fields.back().push_back('\\');
+            }
+            fields.back().push_back(text[++i]);
+        } else if (text[i] == delim) {
+            fields.emplace_back();
+        } else {
+            fields.back().push_back(text[i]);
+        }
+    }
+    return fields;
+}
+
+} // namespace
+
 std::unordered_map<std::string, std::function<void(Editor&)>> command_table = {
     {
         "w",
         [](Editor& editor) { editor.write_file(); },
     },
+    {"w!", [](Editor& editor) { editor.write_file(true); }},
     {"q", [](Editor& editor) { editor.set_should_exit(true); }},
     {"q!",
      [](Editor& editor) {
@@ -20,6 +49,80 @@ std::unordered_map<std::string, std::function<void(Editor&)>> command_table = {
          command_table.at("w")(editor);
          command_table.at("q")(editor);
      }},
+    {"cn", [](Editor& editor) { editor.quickfix_next(false); }},
+    {"cnext", [](Editor& editor) { editor.quickfix_next(false); }},
+    {"cp", [](Editor& editor) { editor.quickfix_next(true); }},
+    {"cprev", [](Editor& editor) { editor.quickfix_next(true); }},
+    {"follow", [](Editor& editor) { editor.toggle_follow(); }},
+    {"reload", [](Editor& editor) { editor.reload_from_disk(); }},
+};
+
+std::vector<std::function<bool(Editor&, std::string_view)>> parsed_commands = {
+    substitute,
+    grep,
 };
 
+bool substitute(Editor& editor, std::string_view cmd) {
+    const bool whole_file = cmd.starts_with('%');
+    if (whole_file) {
+        cmd.remove_prefix(1);
+    }
+    // any non-alphanumeric delimiter, as in vim
+    if (cmd.size() < 2 || cmd[0] != 's' ||
+        std::isalnum(static_cast<unsigned char>(cmd[1])) || cmd[1] == ' ') {
+        return false;
+    }
+
+    const auto fields = split_fields(cmd.substr(2), cmd[1]);
+    const std::string& pattern = fields[0];
+    const std::string replacement = fields.size() > 1 ? fields[1] : "";
+    const std::string flags = fields.size() > 2 ? fields[2] : "";
+    if (pattern.empty()) {
+        editor.show_message("Empty search pattern");
+        return true;
+    }
+    const auto compiled = regex::Regex::compile(pattern);
+    if (!compiled) {
+        editor.show_message("Invalid pattern: " + pattern);
+        return true;
+    }
+
+    const std::size_t row = editor.get_cm().row();
+    const std::size_t first = whole_file ? 0 : row;
+    const std::size_t last = whole_file ? editor.get_buffer().line_count() : row + 1;
+    editor.substitute(*compiled, replacement, first, last,
+                      flags.find('g') != std::string::npos);
+    return true;
+}
+
+bool grep(Editor& editor, std::string_view cmd) {
+    if (!cmd.starts_with("grep ")) {
+        return false;
+    }
+    cmd.remove_prefix(5);
+
+    // whitespace separated: the pattern, then files and directories
+    std::vector<std::string> words;
+    std::size_t pos = 0;
+    while (pos < cmd.size()) {
+        const std::size_t start = cmd.find_first_not_of(' ', pos);
+        if (start == std::string_view::npos) {
+            break;
+        }
+        pos = std::min(cmd.find(' ', start), cmd.size());
+        words.emplace_back(cmd.substr(start, pos - start));
+    }
+    if (words.empty()) {
+        editor.show_message("Usage: grep pattern [paths]");
+        return true;
+    }
+    const auto compiled = regex::Regex::compile(words.front());
+    if (!compiled) {
+        editor.show_message("Invalid pattern: " + words.front());
+        return true;
+    }
+    editor.start_grep(*compiled, {words.begin() + 1, words.end()});
+    return true;
+}
+
 } // namespace Command
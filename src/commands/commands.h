@@ -4,9 +4,19 @@
 #include <functional>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 
 namespace Command {
 //...
 extern std::unordered_map<std::string, std::function<void(Editor&)>>
     command_table;
+// commands that take arguments, tried in order when cmd is not in
+// command_table; each returns false if cmd is not its command
+extern std::vector<std::function<bool(Editor&, std::string_view)>>
+    parsed_commands;
+// ":s/pat/repl/flags" on the cursor row, ":%s/..." on every row; the only
+// flag is 'g'. false if cmd is not a substitute command
+bool substitute(Editor& editor, std::string_view cmd);
+// ":grep pattern [paths...]", searches "." without paths
+bool grep(Editor& editor, std::string_view cmd);
 } // namespace Command
@@ -1,53 +1,298 @@
 #include "buffer.h"
 #include "../utils/deque_gb.h"
+#include "../utils/file_io.h"
+#include "../utils/simd_scan.h"
+#include "undo_file.h"
+#include <algorithm>
 #include <cmath>
+#include <fcntl.h>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <variant>
 
 Buffer::Buffer(const std::string& filepath) {
-    load_file(filepath);
-    if (buffer.empty()) {
-        buffer.emplace_back("");
+    if (start_load(filepath, {})) {
+        finish_load();
     }
-    buffer.at(0) = GapBuffer(get_line(0));
+}
 
-    // populate unwritten buffer
-    for (const auto& line : buffer) {
-        if (std::holds_alternative<std::string>(line)) {
-            original_buffer.push_back(std::get<std::string>(line));
-        } else {
-            original_buffer.push_back(std::get<GapBuffer>(line).to_string());
+Buffer::Buffer(const std::string& filepath, std::function<void()> on_progress)
+    : Buffer(filepath, std::move(on_progress), false) {}
+
+Buffer::Buffer(const std::string& filepath, std::function<void()> on_progress,
+               const bool read_only)
+    : m_read_only(read_only) {
+    start_load(filepath, std::move(on_progress));
+}
+
+bool Buffer::start_load(const std::string& filepath,
+                        std::function<void()> on_progress) {
+    loader.reset();
+    mapped.reset();
+    indexing = false;
+    buffer.clear();
+    original_buffer.clear();
+    gb_idx = 0;
+    m_guard = PerfGuard();
+    m_cache_key.reset();
+    load_size = 0;
+    m_loaded_bytes = 0;
+    if (m_read_only) {
+        return start_mapping(filepath, std::move(on_progress));
+    }
+
+    const int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Error: unable to open file " << filepath << "\n";
+        buffer.emplace_back(GapBuffer());
+        return false;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) == 0) {
+        load_size = static_cast<std::uint64_t>(st.st_size);
+    }
+    m_cache_key = LineCache::key_of(filepath);
+    loader = std::make_unique<FileLoader>(fd, filepath, m_cache_key, std::move(on_progress));
+
+    // the first batch is small, waiting for it puts text on the first frame
+    take_loaded();
+    return true;
+}
+
+bool Buffer::start_mapping(const std::string& filepath,
+                           std::function<void()> on_progress) {
+    // a view follows the line cache like a load does, and keeps the key for
+    // the lexer states stored with it
+    m_cache_key = LineCache::key_of(filepath);
+    mapped = MappedFile::open(filepath, m_cache_key, std::move(on_progress));
+    if (!mapped) {
+        std::cerr << "Error: unable to open file " << filepath << "\n";
+        buffer.emplace_back(GapBuffer());
+        return false;
+    }
+    load_size = mapped->file_size();
+    indexing = true;
+    take_loaded();
+    return true;
+}
+
+void Buffer::take_loaded() {
+    if (mapped) {
+        mapped->wait();
+        const bool done = mapped->done();
+        take_mapped();
+        if (done) {
+            end_load();
         }
+        return;
+    }
+    loader->wait();
+    const bool done = loader->done();
+    append_loaded(loader->take());
+    if (done) {
+        end_load();
     }
 }
 
-bool Buffer::load_file(const std::string& filepath) {
-    std::ifstream file(filepath);
+void Buffer::append_loaded(std::vector<std::string> lines) {
+    const std::size_t row = buffer.size();
+    m_guard = detect_guard(load_size, row + lines.size(), loader->longest_line());
+    // a second copy of a huge file is not worth keeping for revert_buffer()
+    if (m_guard.active) {
+        original_buffer = {};
+    } else {
+        original_buffer.insert(original_buffer.end(), lines.begin(), lines.end());
+    }
+    for (auto& line : lines) {
+        buffer.emplace_back(std::move(line));
+    }
+    if (row == 0 && !buffer.empty()) {
+        gb_idx = 0;
+        buffer[0] = GapBuffer(get_line(0));
+    }
+}
 
-    if (!file.is_open()) {
-        std::cerr << "Error: unable to open file " << filepath << "\n";
+std::size_t Buffer::take_mapped() {
+    const std::size_t added = mapped->take();
+    m_guard = detect_guard(load_size, mapped->line_count(), mapped->longest_line());
+    return added;
+}
+
+void Buffer::end_load() {
+    if (mapped) {
+        m_loaded_bytes = mapped->bytes_scanned();
+        indexing = false;
+        return;
+    }
+    m_loaded_bytes = loader->bytes_read();
+    loader.reset();
+    if (buffer.empty()) {
+        buffer.emplace_back(GapBuffer());
+        if (!m_guard.active) {
+            original_buffer.emplace_back();
+        }
+    }
+}
+
+bool Buffer::poll_load(const bool wait) {
+    if (indexing) {
+        if (wait) {
+            mapped->wait();
+        }
+        const bool done = mapped->done();
+        const std::size_t row = mapped->line_count();
+        if (const std::size_t added = take_mapped(); added > 0) {
+            announce({row, 0, added, true});
+        }
+        if (done) {
+            end_load();
+        }
+        return done;
+    }
+    if (!loader) {
         return false;
     }
+    if (wait) {
+        loader->wait();
+    }
+    // done() first: every line read before it is in this take()
+    const bool done = loader->done();
+    auto lines = loader->take();
+    if (!lines.empty()) {
+        const BufferChange change{buffer.size(), 0, lines.size(), true};
+        append_loaded(std::move(lines));
+        announce(change);
+    }
+    if (done) {
+        end_load();
+    }
+    return done;
+}
 
-    buffer.clear();
+void Buffer::finish_load() {
+    while (loading()) {
+        take_loaded();
+    }
+}
 
-    std::string line;
-    while (std::getline(file, line)) {
-        buffer.emplace_back(line);
+void Buffer::announce(const BufferChange& change) {
+    ++m_version;
+    snapshots.on_change(change);
+    for (const auto& listener : listeners) {
+        listener(change);
     }
+}
 
-    file.close();
+std::uint64_t Buffer::loaded_bytes() const {
+    return m_loaded_bytes;
+}
+
+void Buffer::append_tail(const std::string_view text, const bool continues) {
+    std::vector<std::string> lines;
+    std::size_t from = 0;
+    for (std::size_t cut; (cut = text.find('\n', from)) != std::string_view::npos;
+         from = cut + 1) {
+        lines.emplace_back(text.substr(from, cut - from));
+    }
+    if (from < text.size()) {
+        lines.emplace_back(text.substr(from));
+    }
+    if (lines.empty()) {
+        return;
+    }
+
+    flatten_gap();
+    std::size_t row = buffer.size();
+    std::size_t removed = 0;
+    if (continues) {
+        row = buffer.size() - 1;
+        removed = 1;
+        lines.front().insert(0, std::get<std::string>(buffer[row]));
+    }
+    const std::size_t inserted = lines.size();
+    replace_rows(row, removed, std::move(lines));
+    restore_gap();
+    announce({row, removed, inserted, true});
+}
+
+bool Buffer::read_only() const {
+    return m_read_only;
+}
+
+bool Buffer::truncated() {
+    return mapped && mapped->truncated();
+}
+
+bool Buffer::loading() const {
+    return loader != nullptr || indexing;
+}
+
+std::size_t Buffer::load_percent() const {
+    if (!loading() || load_size == 0) {
+        return 100;
+    }
+    const std::uint64_t read = mapped ? mapped->bytes_scanned() : loader->bytes_read();
+    return static_cast<std::size_t>(read * 100 / load_size);
+}
+
+bool Buffer::open(const std::string& filepath, std::function<void()> on_progress) {
+    if (!std::ifstream(filepath).is_open()) {
+        return false;
+    }
+    const std::size_t old_count = line_count();
+    history = UndoHistory();
+    pending.reset();
+    const bool background = static_cast<bool>(on_progress);
+    start_load(filepath, std::move(on_progress));
+    if (!background) {
+        finish_load();
+    }
+    touch({0, old_count, line_count()});
+    was_modified = false;
     return true;
 }
 
+PerfGuard Buffer::detect_guard(const std::uintmax_t file_size,
+                               const std::size_t lines,
+                               const std::size_t max_line_length) {
+    PerfGuard guard;
+    const auto trip = [&](const std::string& why) {
+        guard.reason += (guard.active ? ", " : "") + why;
+        guard.active = true;
+    };
+
+    if (file_size > PerfGuard::max_file_size) {
+        trip(std::to_string(file_size >> 20) + " MB file");
+    }
+    if (lines > PerfGuard::max_lines) {
+        trip(std::to_string(lines) + " lines");
+    }
+    if (max_line_length > PerfGuard::max_line_length) {
+        trip(std::to_string(max_line_length) + " char line");
+    }
+    if (guard.active) {
+        guard.highlight_cols = PerfGuard::guarded_highlight_cols;
+        guard.reason = "[guard: " + guard.reason + "]";
+    }
+    return guard;
+}
+
 void Buffer::revert_buffer(const std::vector<std::string>& new_buffer) {
+    const std::size_t old_count = buffer.size();
     buffer.clear();
     for (const auto& line : new_buffer) {
         buffer.emplace_back(line);
     }
     buffer.at(0) = GapBuffer(get_line(0));
+    gb_idx = 0;
+    ++m_version;
+    snapshots.reset();
+    for (const auto& listener : listeners) {
+        listener({0, old_count, buffer.size()});
+    }
 }
 
 [[maybe_unused]] void Buffer::revert_buffer() {
@@ -55,10 +300,13 @@ void Buffer::revert_buffer(const std::vector<std::string>& new_buffer) {
 }
 
 std::size_t Buffer::line_count() const {
-    return buffer.size();
+    return mapped ? mapped->line_count() : buffer.size();
 }
 
 std::string Buffer::get_line(std::size_t index) const {
+    if (mapped) {
+        return std::string(mapped->line(index));
+    }
     auto& line = buffer.at(index);
     if (std::holds_alternative<GapBuffer>(line)) {
         return std::get<GapBuffer>(line).to_string();
@@ -67,8 +315,114 @@ std::string Buffer::get_line(std::size_t index) const {
     return std::get<std::string>(line);
 }
 
+std::string_view Buffer::line_view(const std::size_t index) const {
+    return line_view(index, gb_scratch);
+}
+
+std::string_view Buffer::line_view(const std::size_t index,
+                                   std::string& scratch) const {
+    if (mapped) {
+        return mapped->line(index);
+    }
+    auto& line = buffer.at(index);
+    if (std::holds_alternative<GapBuffer>(line)) {
+        scratch = std::get<GapBuffer>(line).to_string();
+        return scratch;
+    }
+
+    return std::get<std::string>(line);
+}
+
 std::size_t Buffer::get_line_length(std::size_t index) const {
-    return get_line(index).length();
+    if (mapped) {
+        return mapped->line(index).size();
+    }
+    auto& line = buffer.at(index);
+    if (std::holds_alternative<GapBuffer>(line)) {
+        return std::get<GapBuffer>(line).size();
+    }
+
+    return std::get<std::string>(line).size();
+}
+
+std::optional<Cursor> Buffer::find(const std::string_view needle,
+                                   const Cursor& from,
+                                   const bool forward) const {
+    if (needle.empty()) {
+        return std::nullopt;
+    }
+
+    // searches the stored text in place, only the gap-buffer line is copied
+    return find_by(
+        [&](const std::string_view text, const std::size_t lo,
+            const std::size_t hi) -> std::optional<std::size_t> {
+            // a match starting before hi may run up to needle.size() - 1 past it
+            const std::size_t limit =
+                hi < text.size() ? std::min(text.size(), hi + needle.size() - 1)
+                                 : text.size();
+            const char* begin = text.data() + std::min(lo, limit);
+            const char* end = text.data() + limit;
+            const char* hit = forward ? scan::find(begin, end, needle)
+                                      : scan::rfind(begin, end, needle);
+            if (hit == end) {
+                return std::nullopt;
+            }
+            return static_cast<std::size_t>(hit - text.data());
+        },
+        from, forward);
+}
+
+std::optional<Cursor> Buffer::find(regex::Matcher& matcher, const Cursor& from,
+                                   const bool forward) const {
+    return find_by(
+        [&](const std::string_view text, const std::size_t lo,
+            const std::size_t hi) -> std::optional<std::size_t> {
+            const auto match = forward ? matcher.find_first(text, lo, hi)
+                                       : matcher.find_last(text, lo, hi);
+            if (!match) {
+                return std::nullopt;
+            }
+            return match->start;
+        },
+        from, forward);
+}
+
+std::optional<Cursor> Buffer::find_by(const LineSearch& search,
+                                      const Cursor& from,
+                                      const bool forward) const {
+    if (line_count() == 0) {
+        return std::nullopt;
+    }
+
+    const auto search_row = [&](const std::size_t row, const std::size_t lo,
+                                const std::size_t hi) -> std::optional<Cursor> {
+        const auto col = search(line_view(row), lo, hi);
+        if (!col) {
+            return std::nullopt;
+        }
+        return Cursor{row, *col, *col};
+    };
+
+    const std::size_t rows = line_count();
+    const std::size_t row = std::min(from.row, rows - 1);
+    // on the starting row only matches on the requested side of `from` count
+    if (const auto hit =
+            forward ? search_row(row, from.col, SIZE_MAX)
+                    : search_row(row, 0, std::min(from.col, SIZE_MAX - 1) + 1)) {
+        return hit;
+    }
+    for (std::size_t k = 1; k <= rows; ++k) {
+        const std::size_t r = forward ? (row + k) % rows : (row + rows - k) % rows;
+        if (const auto hit = search_row(r, 0, SIZE_MAX)) {
+            return hit;
+        }
+    }
+    return std::nullopt;
+}
+
+BufferSnapshot Buffer::snapshot() const {
+    return snapshots.take(line_count(), m_version,
+                          [this](const std::size_t row) { return get_line(row); });
 }
 
 bool Buffer::is_modified() const {
@@ -79,9 +433,218 @@ void Buffer::set_modified(const bool& value) {
     was_modified = value;
 }
 
+std::uint64_t Buffer::version() const {
+    return m_version;
+}
+
+const PerfGuard& Buffer::guard() const {
+    return m_guard;
+}
+
+const std::optional<FileKey>& Buffer::cache_key() const {
+    return m_cache_key;
+}
+
+void Buffer::subscribe(std::function<void(const BufferChange&)> listener) {
+    listeners.push_back(std::move(listener));
+}
+
+void Buffer::before_edit(const std::size_t row, const std::size_t count) {
+    LineEdit edit{row, {}, {}};
+    for (std::size_t i = 0; i < count && row + i < buffer.size(); ++i) {
+        edit.before.push_back(get_line(row + i));
+    }
+    pending = std::move(edit);
+}
+
+void Buffer::touch(const BufferChange& change) {
+    if (pending) {
+        for (std::size_t i = 0; i < change.inserted; ++i) {
+            pending->after.push_back(get_line(change.row + i));
+        }
+        history.record(std::move(*pending));
+        pending.reset();
+    }
+    was_modified = true;
+    ++m_version;
+    snapshots.on_change(change);
+    for (const auto& listener : listeners) {
+        listener(change);
+    }
+}
+
+void Buffer::flatten_gap() {
+    if (gb_idx < buffer.size() &&
+        std::holds_alternative<GapBuffer>(buffer[gb_idx])) {
+        buffer[gb_idx] = std::get<GapBuffer>(buffer[gb_idx]).to_string();
+    }
+}
+
+void Buffer::restore_gap() {
+    if (buffer.empty()) {
+        buffer.emplace_back("");
+    }
+    gb_idx = std::min(gb_idx, buffer.size() - 1);
+    if (std::holds_alternative<std::string>(buffer[gb_idx])) {
+        buffer[gb_idx] = GapBuffer(std::get<std::string>(buffer[gb_idx]));
+    }
+}
+
+void Buffer::replace_rows(const std::size_t row, const std::size_t count,
+                          std::vector<std::string> lines) {
+    const std::size_t common = std::min(count, lines.size());
+    for (std::size_t i = 0; i < common; ++i) {
+        buffer[row + i] = std::move(lines[i]);
+    }
+    const auto tail = buffer.begin() + static_cast<std::ptrdiff_t>(row + common);
+    if (count > common) {
+        buffer.erase(tail, tail + static_cast<std::ptrdiff_t>(count - common));
+    } else {
+        buffer.insert(tail,
+                      std::make_move_iterator(lines.begin() +
+                                              static_cast<std::ptrdiff_t>(common)),
+                      std::make_move_iterator(lines.end()));
+    }
+}
+
+void Buffer::apply(const UndoRecord& record, const bool reverse) {
+    pending.reset();
+    const auto& edits = record.edits;
+    const bool same_shape =
+        std::all_of(edits.begin(), edits.end(), [](const LineEdit& edit) {
+            return edit.before.size() == edit.after.size();
+        });
+
+    flatten_gap();
+    if (same_shape) {
+        // no row moves, so listeners can hear about the whole span at once;
+        // a row may be edited more than once, undo goes back to front
+        std::size_t lo = SIZE_MAX;
+        std::size_t hi = 0;
+        const auto step = [&](const LineEdit& edit) {
+            replace_rows(edit.row, edit.before.size(),
+                         reverse ? edit.before : edit.after);
+            lo = std::min(lo, edit.row);
+            hi = std::max(hi, edit.row + edit.before.size());
+        };
+        if (reverse) {
+            std::for_each(edits.rbegin(), edits.rend(), step);
+        } else {
+            std::for_each(edits.begin(), edits.end(), step);
+        }
+        restore_gap();
+        if (lo < hi) {
+            touch({lo, hi - lo, hi - lo});
+        }
+        return;
+    }
+
+    const auto step = [&](const LineEdit& edit) {
+        const auto& from = reverse ? edit.after : edit.before;
+        const auto& to = reverse ? edit.before : edit.after;
+        replace_rows(edit.row, from.size(), to);
+        touch({edit.row, from.size(), to.size()});
+    };
+    if (reverse) {
+        std::for_each(edits.rbegin(), edits.rend(), step);
+    } else {
+        std::for_each(edits.begin(), edits.end(), step);
+    }
+    restore_gap();
+}
+
+void Buffer::begin_undo_group(const Cursor& cursor) {
+    history.begin_group(cursor);
+}
+
+void Buffer::end_undo_group() {
+    history.end_group();
+}
+
+void Buffer::load_undo(const std::string& undo_path) {
+    // hashing the text is the expensive part, it waits for a candidate file
+    auto file = UndoFile::open(undo_path);
+    if (file && file->content_hash() == content_hash()) {
+        history.attach(std::move(file));
+    }
+}
+
+bool Buffer::save_undo(const std::string& undo_path, const std::uint64_t text_hash) {
+    return history.persist(undo_path, text_hash);
+}
+
+std::uint64_t Buffer::content_hash() const {
+    std::uint64_t hash = file_io::hash_seed;
+    std::string scratch;
+    for (std::size_t i = 0; i < line_count(); ++i) {
+        hash = file_io::hash_bytes(line_view(i, scratch), hash);
+        hash = file_io::hash_bytes("\n", hash);
+    }
+    return hash;
+}
+
+std::optional<Cursor> Buffer::undo() {
+    auto record = history.pop_undo();
+    if (!record) {
+        return std::nullopt;
+    }
+    apply(*record, true);
+    const Cursor cursor = record->cursor;
+    history.push_redo(std::move(*record));
+    return cursor;
+}
+
+std::optional<Cursor> Buffer::redo() {
+    auto record = history.pop_redo();
+    if (!record) {
+        return std::nullopt;
+    }
+    apply(*record, false);
+    const Cursor cursor{record->edits.front().row, 0, 0};
+    history.push_undo(std::move(*record));
+    return cursor;
+}
+
+void Buffer::set_lines(std::vector<std::pair<std::size_t, std::string>> lines) {
+    if (lines.empty()) {
+        return;
+    }
+
+    pending.reset();
+    const std::size_t lo = lines.front().first;
+    const std::size_t hi = lines.back().first + 1;
+    history.begin_group({lo, 0, 0});
+    flatten_gap();
+    for (auto& [row, text] : lines) {
+        auto& slot = buffer[row];
+        std::string old = std::holds_alternative<std::string>(slot)
+                              ? std::move(std::get<std::string>(slot))
+                              : std::get<GapBuffer>(slot).to_string();
+        history.record({row, {std::move(old)}, {text}});
+        slot = std::move(text);
+    }
+    restore_gap();
+    history.end_group();
+    touch({lo, hi - lo, hi - lo});
+}
+
+void Buffer::splice_lines(const std::size_t row, const std::size_t removed,
+                          std::vector<std::string> lines) {
+    before_edit(row, removed);
+    const std::size_t inserted = lines.size();
+    flatten_gap();
+    replace_rows(row, removed, std::move(lines));
+    restore_gap();
+    touch({row, removed, inserted});
+}
+
 // turns gapbuffer back to string and new line to gapbuffer (to be edited)
 // where cm is the current cursor position
 void Buffer::switch_line(const std::size_t new_line_idx) {
+    // a mapped file has no line to edit
+    if (mapped) {
+        return;
+    }
     if (gb_idx != new_line_idx) {
         // Convert current line to string
         if (std::holds_alternative<GapBuffer>(buffer.at(gb_idx))) {
@@ -103,6 +666,9 @@ void Buffer::switch_line(const std::size_t new_line_idx) {
 }
 
 void Buffer::move_cursor(const CursorManager& new_cm) {
+    if (mapped) {
+        return;
+    }
     const auto new_cursor = new_cm.get();
     if (gb_idx != new_cursor.row) {
         switch_line(new_cursor.row);
@@ -114,6 +680,9 @@ void Buffer::move_cursor(const CursorManager& new_cm) {
 }
 
 void Buffer::move_cursor(const Cursor& cursor) {
+    if (mapped) {
+        return;
+    }
     if (gb_idx != cursor.row) {
         switch_line(cursor.row);
     }
@@ -124,12 +693,13 @@ void Buffer::move_cursor(const Cursor& cursor) {
 }
 
 void Buffer::insert(const Cursor& cursor, const char c) {
+    before_edit(cursor.row, 1);
     move_cursor(cursor);
     if (std::holds_alternative<GapBuffer>(buffer.at(cursor.row))) {
         auto& gb_line = std::get<GapBuffer>(buffer.at(cursor.row));
         gb_line.insert(c);
     }
-    was_modified = true;
+    touch({cursor.row, 1, 1});
 }
 
 void Buffer::insert(const CursorManager& cm, const char c) {
@@ -137,6 +707,7 @@ void Buffer::insert(const CursorManager& cm, const char c) {
 }
 
 void Buffer::insert(const Cursor& cursor, std::string string) {
+    before_edit(cursor.row, 1);
     move_cursor(cursor);
     if (std::holds_alternative<GapBuffer>(buffer.at(cursor.row))) {
         auto& gb_line = std::get<GapBuffer>(buffer.at(cursor.row));
@@ -145,6 +716,44 @@ void Buffer::insert(const Cursor& cursor, std::string string) {
             gb_line.insert(*it++);
         }
     }
+    touch({cursor.row, 1, 1});
+}
+
+Cursor Buffer::insert_text(const Cursor& cursor, const std::string_view text) {
+    return replace_text(cursor, cursor, text);
+}
+
+Cursor Buffer::replace_text(const Cursor& from, const Cursor& to,
+                            const std::string_view text) {
+    const std::size_t rows = to.row - from.row + 1;
+    before_edit(from.row, rows);
+    std::string head = get_line(from.row);
+    const std::string last = to.row == from.row ? head : get_line(to.row);
+    const std::size_t col = std::min(from.col, head.size());
+    const std::string tail = last.substr(std::min(to.col, last.size()));
+    head.resize(col);
+
+    std::vector<std::string> lines;
+    std::size_t start = 0;
+    while (true) {
+        const std::size_t nl = text.find('\n', start);
+        lines.emplace_back(text.substr(start, nl - start));
+        if (nl == std::string_view::npos) {
+            break;
+        }
+        start = nl + 1;
+    }
+    const std::size_t end_col = lines.size() == 1 ? col + lines.back().size()
+                                                  : lines.back().size();
+    lines.front().insert(0, head);
+    lines.back() += tail;
+
+    const std::size_t count = lines.size();
+    flatten_gap();
+    replace_rows(from.row, rows, std::move(lines));
+    restore_gap();
+    touch({from.row, rows, count});
+    return {from.row + count - 1, end_col, end_col};
 }
 
 void Buffer::erase(const CursorManager& cm) {
@@ -152,6 +761,7 @@ void Buffer::erase(const CursorManager& cm) {
 }
 
 void Buffer::erase(const Cursor& cursor) {
+    before_edit(cursor.row, 1);
     move_cursor(cursor);
     if (std::holds_alternative<GapBuffer>(buffer.at(cursor.row))) {
         auto& gb_line = std::get<GapBuffer>(buffer.at(cursor.row));
@@ -161,11 +771,12 @@ void Buffer::erase(const Cursor& cursor) {
         }
         gb_line.del();
     }
-    was_modified = true;
+    touch({cursor.row, 1, 1});
 }
 
 void Buffer::new_line(const CursorManager& cm) {
     const std::size_t line_idx = cm.get().row;
+    before_edit(line_idx, 1);
     auto line = get_line(line_idx);
     const auto new_line =
         std::string(line.begin() + static_cast<int>(cm.col()), line.end());
@@ -182,7 +793,7 @@ void Buffer::new_line(const CursorManager& cm) {
         buffer.at(line_idx) =
             std::string(line.begin(), line.begin() + static_cast<int>(cm.col()));
     }
-    was_modified = true;
+    touch({line_idx, 1, 2});
 }
 
 void Buffer::delete_line(const CursorManager& cm) {
@@ -191,14 +802,37 @@ void Buffer::delete_line(const CursorManager& cm) {
 }
 
 void Buffer::delete_line(const std::size_t line_idx) {
+    BufferChange change{line_idx, 1, 0};
+    before_edit(line_idx, 1);
     buffer.erase(buffer.begin() + static_cast<int>(line_idx));
     if (line_idx == 0 && line_count() == 1) {
         buffer.insert(buffer.begin() + static_cast<int>(line_idx), "");
+        change.inserted = 1;
     } else if (line_count() - 1 == line_idx && line_idx != 0) {
 
         switch_line(line_idx - 1);
     }
-    was_modified = true;
+    touch(change);
+}
+
+void Buffer::delete_lines(const std::size_t line_idx, std::size_t count) {
+    count = std::min(count, buffer.size() - line_idx);
+    if (count <= 1) {
+        delete_line(line_idx);
+        return;
+    }
+
+    before_edit(line_idx, count);
+    // the buffer always keeps one (empty) line
+    std::vector<std::string> keep;
+    if (count == buffer.size()) {
+        keep.emplace_back("");
+    }
+    const std::size_t inserted = keep.size();
+    flatten_gap();
+    replace_rows(line_idx, count, std::move(keep));
+    restore_gap();
+    touch({line_idx, count, inserted});
 }
 
 void Buffer::delete_range(const Cursor &start, const Cursor &end) {
@@ -212,6 +846,7 @@ void Buffer::delete_range(const Cursor &start, const Cursor &end) {
         std::swap(actual_start, actual_end);
     }
 
+    before_edit(actual_start.row, actual_end.row - actual_start.row + 1);
     if (actual_start.row == actual_end.row) {
         // Same line: delete the substring from start.col to end.col inclusive
         const std::size_t line_idx = actual_start.row;
@@ -220,34 +855,29 @@ void Buffer::delete_range(const Cursor &start, const Cursor &end) {
 
         if (const std::size_t end_col = std::min(actual_end.col, line.size() - 1); start_col <= end_col) {
             line.erase(start_col, end_col - start_col + 1);
+            flatten_gap();
             buffer[line_idx] = line;
-            was_modified = true;
+            restore_gap();
+            touch({actual_start.row, 1, 1});
         }
     } else {
-        // Multi-line deletion
+        // Multi-line deletion: keep the head of the start line and the tail
+        // of the end line, joined into one row
         std::string start_line = get_line(actual_start.row);
-
-        // Truncate the start line to the start column
         if (const std::size_t start_col = actual_start.col; start_col < start_line.size()) {
             start_line.erase(start_col);
-            buffer[actual_start.row] = start_line;
         }
 
-        // Capture the remaining part of the end line
         const std::string end_line = get_line(actual_end.row);
         const std::size_t end_col_plus1 = actual_end.col + 1;
-        const std::string remaining = end_col_plus1 <= end_line.size()
-                                    ? end_line.substr(end_col_plus1)
-                                    : "";
-
-        // Delete lines from start.row +1 to end.row inclusive
-        const std::size_t lines_to_delete = actual_end.row - actual_start.row;
-        for (std::size_t i = 0; i < lines_to_delete; ++i) {
-            delete_line(actual_start.row + 1);
+        if (end_col_plus1 <= end_line.size()) {
+            start_line += end_line.substr(end_col_plus1);
         }
 
-        // Append the remaining content to the start line
-        buffer[actual_start.row] = get_line(actual_start.row) + remaining;
-        was_modified = true;
+        const std::size_t rows = actual_end.row - actual_start.row + 1;
+        flatten_gap();
+        replace_rows(actual_start.row, rows, {std::move(start_line)});
+        restore_gap();
+        touch({actual_start.row, rows, 1});
     }
 }
@@ -2,14 +2,50 @@
 
 #include "../utils/deque_gb.h"
 #include "../utils/log.h"
+#include "../utils/regex.h"
 #include "cursor.h"
+#include "line_cache.h"
+#include "loader.h"
+#include "mapped_file.h"
+#include "snapshot.h"
+#include "undo.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <variant>
 #include <vector>
 
 // forward decl
 class CursorManager;
 
+// set at load time when a file is too big to handle with every feature on
+struct PerfGuard {
+    // thresholds, any one of them trips the guard
+    static constexpr std::uintmax_t max_file_size = 64ull << 20;
+    static constexpr std::size_t max_lines = 1'000'000;
+    static constexpr std::size_t max_line_length = 10'000;
+    static constexpr std::size_t guarded_highlight_cols = 1000;
+
+    bool active = false;
+    std::string reason;
+    // columns past this are drawn without highlighting
+    std::size_t highlight_cols = SIZE_MAX;
+};
+
+// rows [row, row + removed) were replaced by `inserted` rows
+struct BufferChange {
+    std::size_t row;
+    std::size_t removed;
+    std::size_t inserted;
+    // rows read from the file, by a load in progress or a followed file
+    // growing; the text was not edited
+    bool loaded = false;
+};
+
 class Buffer {
 private:
     std::vector<std::variant<std::string, GapBuffer>> buffer;
@@ -17,11 +53,92 @@ private:
     std::size_t gb_idx = 0;
     Logger tb_logger = Logger("../logfile.txt");
     bool was_modified = false;
+    // bumped on every mutation so background readers can detect stale copies
+    std::uint64_t m_version = 0;
+    std::vector<std::function<void(const BufferChange&)>> listeners;
+    PerfGuard m_guard;
+    // the version on disk that was loaded, if it is big enough to cache
+    std::optional<FileKey> m_cache_key;
+    // reads the rest of the file while the first rows are already shown
+    std::unique_ptr<FileLoader> loader;
+    std::uint64_t load_size = 0;
+    std::uint64_t m_loaded_bytes = 0; // of the file, once the load completed
+    // view only (-R): rows are read straight from the mapped file, `buffer`
+    // and original_buffer stay empty and nothing may edit
+    bool m_read_only = false;
+    std::unique_ptr<MappedFile> mapped;
+    bool indexing = false; // the mapped file is still being scanned
+    // backing storage for line_view() of the gap-buffer line
+    mutable std::string gb_scratch;
+    UndoHistory history;
+    // rows saved by before_edit(), completed and recorded by touch()
+    std::optional<LineEdit> pending;
+    mutable SnapshotCache snapshots;
+
+    // first (forward) or last start of a match in [lo, hi) of one line
+    using LineSearch = std::function<std::optional<std::size_t>(
+        std::string_view line, std::size_t lo, std::size_t hi)>;
+
+    // empties the buffer and reads the first batch of filepath; false (with
+    // one empty row) if it cannot be opened
+    bool start_load(const std::string& filepath, std::function<void()> on_progress);
+    // the same for a read-only buffer, which maps the file instead
+    bool start_mapping(const std::string& filepath, std::function<void()> on_progress);
+    // waits for the next batch and takes it in, without notifying listeners
+    void take_loaded();
+    // the line ends found since the last call; the count of rows added
+    std::size_t take_mapped();
+    void append_loaded(std::vector<std::string> lines);
+    void end_load();
+    void finish_load();
+    // version bump and listeners for rows that came from the file
+    void announce(const BufferChange& change);
+    void before_edit(std::size_t row, std::size_t count);
+    void touch(const BufferChange& change);
+    // raw row surgery for batched edits and undo, nothing is recorded; the
+    // gap-buffer line is stored as a string while rows move around it
+    void flatten_gap();
+    void restore_gap();
+    void replace_rows(std::size_t row, std::size_t count,
+                      std::vector<std::string> lines);
+    void apply(const UndoRecord& record, bool reverse);
+    std::optional<Cursor> find_by(const LineSearch& search, const Cursor& from,
+                                  bool forward) const;
+    static PerfGuard detect_guard(std::uintmax_t file_size, std::size_t lines,
+                                  std::size_t max_line_length);
 
 public:
+    // reads the whole file
     explicit Buffer(const std::string& filepath);
+    // reads the first batch, the rest arrives through poll_load(); the
+    // loader calls on_progress from its thread whenever there is more
+    Buffer(const std::string& filepath, std::function<void()> on_progress);
+    // with read_only, the file is mapped and rows are never copied out of
+    // it; the mutating members below must not be called
+    Buffer(const std::string& filepath, std::function<void()> on_progress,
+           bool read_only);
 
-    bool load_file(const std::string& filepath);
+    // replaces the contents with another file, history and guard start over;
+    // false (and nothing changes) if it cannot be read. With on_progress it
+    // loads in the background like the constructor above
+    bool open(const std::string& filepath, std::function<void()> on_progress = {});
+
+    bool read_only() const;
+    // a read-only buffer whose file was cut short in place: the rows past
+    // its new end are dropped and the file should be opened again
+    bool truncated();
+    // the file is still being read, rows keep being appended
+    bool loading() const;
+    std::size_t load_percent() const;
+    // appends the rows read since the last call (listeners see a `loaded`
+    // change); true once the load completed. With `wait`, blocks for the
+    // next batch first
+    bool poll_load(bool wait = false);
+    // bytes of the file the completed load read
+    std::uint64_t loaded_bytes() const;
+    // text appended to the file since (see FileFollower), not an edit: the
+    // first line continues the last row if `continues`, the rest are new rows
+    void append_tail(std::string_view text, bool continues);
 
     [[maybe_unused]] void revert_buffer();
     void revert_buffer(const std::vector<std::string>& new_buffer);
@@ -30,11 +147,56 @@ public:
 
     // turns gapbuffer to string if buffer[index] is gb
     std::string get_line(std::size_t index) const;
+    // no copy for plain lines; the view is valid until the next mutation or
+    // line_view() call
+    std::string_view line_view(std::size_t index) const;
+    // same, with caller-owned scratch so worker threads can read concurrently
+    // while the buffer is not being mutated
+    std::string_view line_view(std::size_t index, std::string& scratch) const;
 
     std::size_t get_line_length(std::size_t index) const;
 
+    // the current text as an immutable version that other threads can read
+    // while editing goes on; only the chunks edited since the last snapshot
+    // are copied
+    BufferSnapshot snapshot() const;
+
+    // first match starting at or after `from` (forward) or at or before it
+    // (backward), wrapping around the end of the buffer
+    std::optional<Cursor> find(std::string_view needle, const Cursor& from,
+                               bool forward) const;
+    std::optional<Cursor> find(regex::Matcher& matcher, const Cursor& from,
+                               bool forward) const;
+
     bool is_modified() const;
     void set_modified(const bool& value);
+    std::uint64_t version() const;
+    const PerfGuard& guard() const;
+    const std::optional<FileKey>& cache_key() const;
+
+    // called after every mutation with the rows it affected
+    void subscribe(std::function<void(const BufferChange&)> listener);
+
+    // edits between begin and end are undone as one step
+    void begin_undo_group(const Cursor& cursor);
+    void end_undo_group();
+    // picks up the history saved for exactly this text, if any; only the
+    // file header is read, records are decoded as undo reaches them
+    void load_undo(const std::string& undo_path);
+    // after a save of text with this content hash
+    bool save_undo(const std::string& undo_path, std::uint64_t text_hash);
+    // hash of the text as written to disk, see file_io::hash_bytes
+    std::uint64_t content_hash() const;
+    // cursor to restore, nullopt if there is nothing to undo/redo
+    std::optional<Cursor> undo();
+    std::optional<Cursor> redo();
+
+    // replaces the text of whole rows as one edit, rows sorted and unique;
+    // the batched path for substitutions, one notification for the lot
+    void set_lines(std::vector<std::pair<std::size_t, std::string>> lines);
+    // rows [row, row + removed) become `lines`, as one edit
+    void splice_lines(std::size_t row, std::size_t removed,
+                      std::vector<std::string> lines);
 
     // has to make original edited line a string and new line a gapbuffer
     void switch_line(std::size_t new_line_idx);
@@ -45,6 +207,11 @@ public:
     void insert(const Cursor& cursor, char c);
     void insert(const Cursor& cursor, std::string string);
     void insert(const CursorManager& cm, char c);
+    // text may span lines ('\n'), spliced in as one edit; returns the
+    // position just past the inserted text
+    Cursor insert_text(const Cursor& cursor, std::string_view text);
+    // replaces the text from `from` up to (not including) `to` the same way
+    Cursor replace_text(const Cursor& from, const Cursor& to, std::string_view text);
 
     void erase(const Cursor& cursor);
     void erase(const CursorManager& cm);
@@ -54,4 +221,6 @@ public:
     void new_line(const CursorManager& cm);
     void delete_line(const CursorManager& cm);
     void delete_line(std::size_t line_idx);
+    // count rows from line_idx (clamped to the end) as one splice
+    void delete_lines(std::size_t line_idx, std::size_t count);
 };
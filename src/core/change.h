@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/*
+ The last change, kept for "." as what it did rather than the keys that did
+ it. Positions are relative to the cursor, so a repeat is one buffer
+ operation wherever it is applied.
+*/
+
+struct Change {
+    enum class Kind {
+        None,
+        Insert,      // an insert session
+        DeleteLines, // "dd"
+        DeleteRange, // visual "d"
+    };
+    Kind kind = Kind::None;
+
+    // Insert: `erased` characters before the cursor were backspaced over,
+    // then `text` was typed ('\n' for Enter); `append` if entered with "a"
+    bool append = false;
+    std::size_t erased = 0;
+    std::string text{};
+
+    // DeleteLines: rows from the cursor down
+    std::size_t count = 1;
+
+    // DeleteRange: inclusive end, `rows` below the start; a one-row range
+    // keeps its width (`end_col` is relative), a longer one its end column
+    std::size_t rows = 0;
+    std::size_t end_col = 0;
+};
@@ -1,5 +1,6 @@
 #include "cursor.h"
 #include "../defs.h"
+#include <algorithm>
 
 CursorManager::CursorManager(Buffer &buffer, const Cursor &arg_cursor)
     : m_cursor(arg_cursor), m_buffer(buffer) {}
@@ -53,13 +54,40 @@ void CursorManager::move_dir(const Direction direction) {
 }
 
 void CursorManager::move_abs(const Cursor& pos) {
-    if (pos.row <= m_buffer.line_count() &&
-        pos.col < m_buffer.get_line_length(pos.row)) {
+    // column 0 is always valid, even on an empty line
+    if (pos.row < m_buffer.line_count() &&
+        (pos.col < m_buffer.get_line_length(pos.row) || pos.col == 0)) {
         m_cursor.col = pos.col;
         m_cursor.row = pos.row;
+        m_cursor.original_col = pos.col;
     }
 }
 
+void CursorManager::move_to_row(const std::size_t row) {
+    m_cursor.row = std::min(row, m_buffer.line_count() - 1);
+    const std::size_t length = m_buffer.get_line_length(m_cursor.row);
+    m_cursor.col = length == 0 ? 0 : std::min(m_cursor.original_col, length - 1);
+}
+
+void CursorManager::move_rows(const Direction direction, const std::size_t count) {
+    if (direction == Direction::Down) {
+        move_to_row(m_cursor.row + std::min(count, m_buffer.line_count()));
+    } else if (direction == Direction::Up) {
+        move_to_row(count > m_cursor.row ? 0 : m_cursor.row - count);
+    }
+}
+
+void CursorManager::move_cols(const Direction direction, const std::size_t count) {
+    if (direction == Direction::Left) {
+        m_cursor.col = count > m_cursor.col ? 0 : m_cursor.col - count;
+    } else if (direction == Direction::Right) {
+        const std::size_t length = m_buffer.get_line_length(m_cursor.row);
+        const std::size_t last = length == 0 ? 0 : length - 1;
+        m_cursor.col = std::max(m_cursor.col, std::min(m_cursor.col + std::min(count, length), last));
+    }
+    m_cursor.original_col = m_cursor.col;
+}
+
 const Cursor& CursorManager::get() {
     return m_cursor;
 }
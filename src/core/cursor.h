@@ -30,4 +30,9 @@ public:
 
     void move_dir(Direction direction);
     void move_abs(const Cursor& pos);
+    // row clamped to the buffer, column from the sticky original_col
+    void move_to_row(std::size_t row);
+    // count steps at once, same clamping as repeating move_dir / "l"
+    void move_rows(Direction direction, std::size_t count);
+    void move_cols(Direction direction, std::size_t count);
 };
@@ -0,0 +1,67 @@
+#include "disk_watch.h"
+#include <filesystem>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+DiskWatch::DiskWatch(const std::string& path)
+    : path(path), name(fs::path(path).filename().string()), known(stamp_of(path)) {
+    std::string dir = fs::path(path).parent_path().string();
+    if (dir.empty()) {
+        dir = ".";
+    }
+    inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd >= 0 &&
+        ::inotify_add_watch(inotify_fd, dir.c_str(),
+                            IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0) {
+        ::close(inotify_fd);
+        inotify_fd = -1;
+    }
+}
+
+DiskWatch::~DiskWatch() {
+    if (inotify_fd >= 0) {
+        ::close(inotify_fd);
+    }
+}
+
+DiskWatch::Stamp DiskWatch::stamp_of(const std::string& path) {
+    struct stat st {};
+    if (::stat(path.c_str(), &st) != 0) {
+        return {};
+    }
+    return {true, static_cast<std::uint64_t>(st.st_size),
+            static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 +
+                st.st_mtim.tv_nsec};
+}
+
+bool DiskWatch::valid() const {
+    return inotify_fd >= 0;
+}
+
+int DiskWatch::fd() const {
+    return inotify_fd;
+}
+
+void DiskWatch::sync() {
+    known = stamp_of(path);
+}
+
+bool DiskWatch::changed() {
+    bool touched = false;
+    alignas(inotify_event) char events[4096];
+    ssize_t n;
+    while ((n = ::read(inotify_fd, events, sizeof(events))) > 0) {
+        for (const char* p = events; p < events + n;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(p);
+            // the name is NUL padded
+            if (event->len > 0 && event->name == name) {
+                touched = true;
+            }
+            p += sizeof(inotify_event) + event->len;
+        }
+    }
+    return touched && stamp_of(path) != known;
+}
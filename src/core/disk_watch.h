@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+ Notices when another program changes the open file. The directory is
+ watched rather than the file, so a save that replaces the file through a
+ rename is seen the same as a write in place. Only finished writes count
+ (IN_CLOSE_WRITE, a rename into place, removal): a file still being written
+ is left alone until its writer closes it, growth as it happens is what
+ :follow is for. An event only prompts a look at the file's size and
+ mtime, which are compared with those of the version the buffer last
+ matched.
+*/
+
+class DiskWatch {
+public:
+    struct Stamp {
+        bool exists = false;
+        std::uint64_t size = 0;
+        std::int64_t mtime_ns = 0;
+
+        bool operator==(const Stamp&) const = default;
+    };
+
+private:
+    int inotify_fd = -1;
+    std::string path;
+    std::string name; // of the file inside the watched directory
+    Stamp known;
+
+public:
+    // synced to the file as it is now
+    explicit DiskWatch(const std::string& path);
+    ~DiskWatch();
+
+    DiskWatch(const DiskWatch&) = delete;
+    DiskWatch& operator=(const DiskWatch&) = delete;
+
+    static Stamp stamp_of(const std::string& path);
+
+    bool valid() const;
+    // readable when inotify has events
+    int fd() const;
+    // the buffer matches the file as it is on disk now (loaded or saved)
+    void sync();
+    // drains the events; true if one of them was about the file and it is
+    // no longer the version last synced
+    bool changed();
+};
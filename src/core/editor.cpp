@@ -4,36 +4,105 @@
 #include "buffer.h"
 #include "cursor.h"
 #include "tui.h"
-#include <fstream>
-#include <iostream>
+#include "line_diff.h"
+#include "undo_file.h"
+#include <algorithm>
+#include <filesystem>
+#include <future>
 #include <notcurses/notcurses.h>
 #include <string>
+#include <utility>
 
-// A helper to convert an integer key to a string.
-std::string int_to_str(const int value) {
-    return {static_cast<char>(value)};
+Editor::Editor(const std::string& filepath, const bool read_only)
+    : buffer(filepath, [this] { wake(); }, read_only), tui(buffer, filepath), cm(buffer), viewport({0, 0}),
+      m_filepath(filepath), language(&lex::language_for(filepath)),
+      should_exit(false),
+      semantic(std::in_place, filepath, !buffer.guard().active && !read_only,
+               [this] { wake(); }),
+      matches(buffer, pool, [this] { wake(); }), normal_dispatch(Keybindings::normal_keys),
+      visual_dispatch(Keybindings::visual_keys) {
+    buffer.subscribe([this](const BufferChange& change) {
+        matches.on_change(change);
+        // rows appended from the file leave the ones above untouched (a
+        // followed file may extend its last row); the journal only logs edits
+        if (!change.loaded || change.removed > 0) {
+            highlight_states.invalidate_from(change.row);
+        }
+        if (!change.loaded) {
+            journal.record(buffer, change);
+        }
+    });
+    load_cached_states();
 }
 
-Editor::Editor(const std::string& filepath)
-    : tui(buffer, filepath), cm(buffer), viewport({0, 0}), buffer(filepath),
-      m_filepath(filepath), should_exit(false) {
+void Editor::write_file(const bool force) {
+    if (refuse_edit()) {
+        return;
+    }
+    if (buffer.loading()) {
+        tui.render_message("\"" + m_filepath + "\" is still loading");
+        return;
+    }
+    // a save that finished before the loop got to it still has to mark the
+    // buffer saved
+    finish_save();
+    if (disk_changed && !force) {
+        tui.render_message(m_filepath + " changed on disk, ':w!' to overwrite it "
+                                        "or ':reload' to load it");
+        return;
+    }
+    if (save && save->running()) {
+        tui.render_message("A save is already in progress");
+        return;
+    }
+    save = std::make_unique<BackgroundSave>(m_filepath, buffer.snapshot(),
+                                            [this] { wake(); });
 }
 
-void Editor::write_file() {
-    std::ofstream file(m_filepath, std::ios::trunc);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open existing file: " << m_filepath << '\n';
+void Editor::finish_save() {
+    if (!save || save->running()) {
         return;
     }
-
-    for (std::size_t i = 0; i < buffer.line_count(); i++) {
-        file << buffer.get_line(i) << '\n';
+    if (save->succeeded()) {
+        disk_changed = false;
+        if (disk_watch) {
+            disk_watch->sync();
+        }
+        // the log only has to cover what the file on disk does not
+        if (buffer.version() == save->version()) {
+            buffer.set_modified(false);
+            journal.rebase();
+            if (!buffer.guard().active) {
+                buffer.save_undo(UndoFile::path_for(m_filepath), save->content_hash());
+            }
+        } else {
+            journal.compact(buffer.snapshot());
+        }
+        tui.set_message("\"" + m_filepath + "\" " + std::to_string(save->bytes_total()) +
+                        " bytes written");
+    } else {
+        tui.set_message("Cannot write " + m_filepath + ": " + save->error());
     }
-    file.close();
-    buffer.set_modified(false);
+    save.reset();
 }
 
 void Editor::set_mode(const Mode mode) {
+    if (mode == Mode::Insert && refuse_edit()) {
+        return;
+    }
+    // a whole insert session is one undo step
+    if (mode == Mode::Insert && curr_mode != Mode::Insert) {
+        buffer.begin_undo_group(cm.get());
+        insert_draft = {.kind = Change::Kind::Insert};
+    } else if (curr_mode == Mode::Insert && mode != Mode::Insert) {
+        buffer.end_undo_group();
+        if (insert_draft.erased > 0 || !insert_draft.text.empty()) {
+            last_change = std::move(insert_draft);
+        }
+    }
+    normal_dispatch.reset();
+    visual_dispatch.reset();
+
     if (curr_mode == Mode::Visual && mode != Mode::Visual) {
         m_visual_start = std::nullopt;
         m_visual_end = std::nullopt;
@@ -44,6 +113,10 @@ void Editor::set_mode(const Mode mode) {
     curr_mode = mode;
 }
 
+std::size_t Editor::count_or(const std::size_t fallback) const {
+    return m_count > 0 ? m_count : fallback;
+}
+
 void Editor::set_visual_end(const Cursor& cursor) {
     if (cursor > m_visual_end.value()) {
         m_visual_end = cursor;
@@ -55,12 +128,19 @@ void Editor::set_visual_end(const Cursor& cursor) {
 void Editor::insert_mode(const int input) {
     // For our Notcurses version, we assume input is an ASCII code.
     if (input == NCKEY_ESC) { // ESC key
-        curr_mode = Mode::Normal;
+        set_mode(Mode::Normal);
         return;
     }
 
     switch (input) {
     case NCKEY_BACKSPACE: // Backspace (typically 127)
+        if (cm.col() > 0 || cm.row() > 0) {
+            if (insert_draft.text.empty()) {
+                ++insert_draft.erased;
+            } else {
+                insert_draft.text.pop_back();
+            }
+        }
         if (cm.col() > 0) {
             buffer.erase(cm);
             cm.move_dir(Direction::Left);
@@ -79,24 +159,37 @@ void Editor::insert_mode(const int input) {
         }
         break;
     case NCKEY_ENTER: // Enter key
+        insert_draft.text.push_back('\n');
         buffer.new_line(cm);
         cm.move_dir(Direction::Down);
         cm.move_abs({cm.row(), 0});
         buffer.move_cursor(cm);
         break;
     default:
+        insert_draft.text.push_back(static_cast<char>(input));
         buffer.insert(cm, static_cast<char>(input));
         cm.move_dir(Direction::Right);
     }
 }
 
+void Editor::start_insert(const bool append) {
+    if (refuse_edit()) {
+        return;
+    }
+    if (append) {
+        cm.move_dir(Direction::Right);
+    }
+    set_mode(Mode::Insert);
+    insert_draft.append = append;
+}
+
 void Editor::command_mode() {
     // Use a simple loop with NotcursesTUI::get_char() to collect a command.
     std::string cmd;
     tui.render_command_line(""); // Clear prompt
 
     int ch;
-    while ((ch = tui.get_char()) != NCKEY_ENTER) {
+    while ((ch = read_key()) != NCKEY_ENTER) {
         if (ch == NCKEY_ESC) { // ESC key
             curr_mode = Mode::Normal;
             return;
@@ -112,10 +205,688 @@ void Editor::command_mode() {
         }
         tui.render_command_line(cmd);
     }
-    execute(Command::command_table, cmd);
+    if (!execute(Command::command_table, cmd) &&
+        std::none_of(Command::parsed_commands.begin(),
+                     Command::parsed_commands.end(),
+                     [&](const auto& command) { return command(*this, cmd); })) {
+        tui.render_message("Not an editor command: " + cmd);
+    }
     curr_mode = Mode::Normal;
 }
 
+// the position one step past `pos` in the search direction
+static Cursor search_step(const Cursor& pos, const bool forward,
+                          const std::size_t line_count) {
+    if (forward) {
+        return {pos.row, pos.col + 1, pos.col + 1};
+    }
+    if (pos.col > 0) {
+        return {pos.row, pos.col - 1, pos.col - 1};
+    }
+    // end of the previous line, wrapping to the last one
+    const std::size_t row = pos.row > 0 ? pos.row - 1 : line_count - 1;
+    return {row, SIZE_MAX, SIZE_MAX};
+}
+
+// keeps a restored cursor inside the (possibly shorter) buffer; also puts
+// an empty match past the end of a line ("$") on its last character
+static Cursor clamp_cursor(const Buffer& buffer, const Cursor& pos) {
+    const std::size_t row = std::min(pos.row, buffer.line_count() - 1);
+    const std::size_t length = buffer.get_line_length(row);
+    const std::size_t col = length == 0 ? 0 : std::min(pos.col, length - 1);
+    return {row, col, col};
+}
+
+// lookup for a partially typed pattern, nothing while it does not parse
+static std::optional<Cursor> find_pattern(const Buffer& buffer,
+                                          const std::optional<regex::Regex>& re,
+                                          const Cursor& from, const bool forward) {
+    if (!re) {
+        return std::nullopt;
+    }
+    if (re->literal()) {
+        return buffer.find(*re->literal(), from, forward);
+    }
+    regex::Matcher matcher(*re);
+    return buffer.find(matcher, from, forward);
+}
+
+void Editor::start_search(const bool forward) {
+    search_forward = forward;
+    set_mode(Mode::Search);
+}
+
+void Editor::search_mode() {
+    const Cursor origin = cm.get();
+    const Cursor start = search_step(origin, search_forward, buffer.line_count());
+    const std::string prompt = search_forward ? "/" : "?";
+    std::string pattern;
+    std::optional<Cursor> match;
+    tui.render_message(prompt);
+
+    int ch;
+    while ((ch = read_key()) != NCKEY_ENTER) {
+        if (ch == NCKEY_ESC) {
+            cm.move_abs(origin);
+            curr_mode = Mode::Normal;
+            return;
+        }
+        if (ch == NCKEY_BACKSPACE) {
+            if (pattern.empty()) {
+                cm.move_abs(origin);
+                curr_mode = Mode::Normal;
+                return;
+            }
+            pattern.pop_back();
+            // a shorter pattern may match earlier, rescan from the start
+            match = find_pattern(buffer, regex::Regex::compile(pattern), start,
+                                 search_forward);
+        } else {
+            const bool had_match = match.has_value() || pattern.empty();
+            pattern.push_back(static_cast<char>(ch));
+            const auto compiled = regex::Regex::compile(pattern);
+            if (compiled && compiled->literal()) {
+                // every match of a longer literal is a match of the shorter
+                // one, so the scan resumes at the previous hit, and a miss
+                // stays a miss
+                if (had_match) {
+                    match = buffer.find(pattern, match.value_or(start),
+                                        search_forward);
+                }
+            } else {
+                match = find_pattern(buffer, compiled, start, search_forward);
+            }
+        }
+
+        cm.move_abs(match ? clamp_cursor(buffer, *match) : origin);
+        update_view();
+        tui.render_message(prompt + pattern);
+    }
+
+    curr_mode = Mode::Normal;
+    if (pattern.empty()) {
+        cm.move_abs(origin);
+        return;
+    }
+    const auto compiled = regex::Regex::compile(pattern);
+    if (!compiled) {
+        cm.move_abs(origin);
+        tui.render_message("Invalid pattern: " + pattern);
+        return;
+    }
+    search_pattern = pattern;
+    matches.set_pattern(*compiled);
+    hlsearch.set_pattern(*compiled);
+    if (!match) {
+        tui.render_message("Pattern not found: " + pattern);
+    }
+}
+
+void Editor::search_next(const bool reverse) {
+    if (!matches.active()) {
+        tui.render_message("No previous search pattern");
+        return;
+    }
+    const bool forward = search_forward != reverse;
+    const auto hit = matches.next(cm.get(), forward);
+    if (!hit) {
+        tui.render_message("Pattern not found: " + search_pattern);
+        return;
+    }
+    cm.move_abs(clamp_cursor(buffer, {hit->match.row, hit->match.col, hit->match.col}));
+}
+
+
+void Editor::undo() {
+    if (refuse_edit()) {
+        return;
+    }
+    if (const auto cursor = buffer.undo()) {
+        cm.move_abs(clamp_cursor(buffer, *cursor));
+    } else {
+        tui.render_message("Already at oldest change");
+    }
+}
+
+void Editor::redo() {
+    if (refuse_edit()) {
+        return;
+    }
+    if (const auto cursor = buffer.redo()) {
+        cm.move_abs(clamp_cursor(buffer, *cursor));
+    } else {
+        tui.render_message("Already at newest change");
+    }
+}
+
+void Editor::delete_lines(const std::size_t count) {
+    if (refuse_edit()) {
+        return;
+    }
+    buffer.delete_lines(cm.row(), count);
+    cm.move_to_row(cm.row());
+    last_change = {.kind = Change::Kind::DeleteLines, .count = count};
+}
+
+void Editor::delete_selection() {
+    if (refuse_edit()) {
+        return;
+    }
+    const Cursor start = m_visual_start.value();
+    const Cursor end = m_visual_end.value();
+    logger.log(std::to_string(start.row) + ", " + std::to_string(start.col) +
+               " : " + std::to_string(end.row) + ", " + std::to_string(end.col));
+    buffer.delete_range(start, end);
+    cm.move_abs(start);
+    set_mode(Mode::Normal);
+
+    const std::size_t rows = end.row - start.row;
+    last_change = {.kind = Change::Kind::DeleteRange,
+                   .rows = rows,
+                   .end_col = rows == 0 ? end.col - start.col : end.col};
+}
+
+// the cursor `count` characters before `pos`, a line break counting as one
+static Cursor step_back(const Buffer& buffer, Cursor pos, std::size_t count) {
+    while (count > pos.col && pos.row > 0) {
+        count -= pos.col + 1;
+        --pos.row;
+        pos.col = buffer.get_line_length(pos.row);
+    }
+    pos.col -= std::min(count, pos.col);
+    return pos;
+}
+
+void Editor::repeat_change() {
+    if (refuse_edit()) {
+        return;
+    }
+    // a count replaces the one of the original change
+    const Change& change = last_change;
+    switch (change.kind) {
+    case Change::Kind::None:
+        break;
+    case Change::Kind::Insert: {
+        if (change.append && buffer.get_line_length(cm.row()) > 0) {
+            cm.move_dir(Direction::Right);
+        }
+        const Cursor at = {cm.row(), cm.col(), cm.col()};
+        std::string text;
+        text.reserve(change.text.size() * count_or(1));
+        for (std::size_t i = 0; i < count_or(1); ++i) {
+            text += change.text;
+        }
+        const Cursor end =
+            buffer.replace_text(step_back(buffer, at, change.erased), at, text);
+        // like leaving insert mode: on the last inserted character
+        cm.move_abs(clamp_cursor(buffer, {end.row, end.col > 0 ? end.col - 1 : 0,
+                                          end.col > 0 ? end.col - 1 : 0}));
+        buffer.move_cursor(cm);
+        break;
+    }
+    case Change::Kind::DeleteLines:
+        delete_lines(count_or(change.count));
+        break;
+    case Change::Kind::DeleteRange: {
+        const Cursor start = cm.get();
+        const std::size_t row =
+            std::min(start.row + change.rows, buffer.line_count() - 1);
+        const std::size_t col =
+            change.rows == 0 ? start.col + change.end_col : change.end_col;
+        buffer.delete_range(start, {row, col, col});
+        cm.move_abs(clamp_cursor(buffer, start));
+        break;
+    }
+    }
+}
+
+// `replacement` with '&' standing for the matched text ("\&" for a literal
+// '&', "\\" for a backslash) substituted for every match in `line`
+static std::string expand_matches(const std::string_view line,
+                                  const std::vector<regex::Match>& found,
+                                  const std::string_view replacement) {
+    std::string out;
+    out.reserve(line.size() + found.size() * replacement.size());
+    std::size_t copied = 0;
+    for (const auto& match : found) {
+        out.append(line.substr(copied, match.start - copied));
+        for (std::size_t i = 0; i < replacement.size(); ++i) {
+            if (replacement[i] == '&') {
+                out.append(line.substr(match.start, match.length));
+            } else if (replacement[i] == '\\' && i + 1 < replacement.size()) {
+                out.push_back(replacement[++i]);
+            } else {
+                out.push_back(replacement[i]);
+            }
+        }
+        copied = match.start + match.length;
+    }
+    out.append(line.substr(copied));
+    return out;
+}
+
+std::size_t Editor::substitute(const regex::Regex& pattern,
+                               const std::string_view replacement,
+                               const std::size_t first, const std::size_t last,
+                               const bool global) {
+    if (refuse_edit()) {
+        return 0;
+    }
+    struct Part {
+        std::vector<std::pair<std::size_t, std::string>> lines;
+        std::size_t count = 0;
+    };
+
+    // rows are split evenly across the pool, each task reads through its own
+    // scratch and matcher; the buffer is only written once they are joined
+    const std::size_t rows = last - first;
+    const std::size_t tasks =
+        std::clamp<std::size_t>(rows / 1024, 1, pool.size());
+    std::vector<std::future<Part>> parts;
+    parts.reserve(tasks);
+    for (std::size_t t = 0; t < tasks; ++t) {
+        const std::size_t lo = first + rows * t / tasks;
+        const std::size_t hi = first + rows * (t + 1) / tasks;
+        parts.push_back(pool.submit([&, lo, hi] {
+            Part part;
+            regex::Matcher matcher(pattern);
+            std::string scratch;
+            std::vector<regex::Match> found;
+            for (std::size_t row = lo; row < hi; ++row) {
+                const std::string_view text = buffer.line_view(row, scratch);
+                found.clear();
+                if (global) {
+                    matcher.find_all(text, found);
+                } else if (const auto match = matcher.find_first(text, 0, SIZE_MAX)) {
+                    found.push_back(*match);
+                }
+                if (found.empty()) {
+                    continue;
+                }
+                part.lines.emplace_back(row, expand_matches(text, found, replacement));
+                part.count += found.size();
+            }
+            return part;
+        }));
+    }
+
+    std::vector<std::pair<std::size_t, std::string>> lines;
+    std::size_t count = 0;
+    for (auto& future : parts) {
+        Part part = future.get();
+        count += part.count;
+        if (lines.empty()) {
+            lines = std::move(part.lines);
+        } else {
+            lines.insert(lines.end(), std::make_move_iterator(part.lines.begin()),
+                         std::make_move_iterator(part.lines.end()));
+        }
+    }
+
+    if (count == 0) {
+        tui.render_message("Pattern not found");
+        return 0;
+    }
+    const std::size_t changed = lines.size();
+    const std::size_t last_row = lines.back().first;
+    buffer.set_lines(std::move(lines));
+    cm.move_abs({last_row, 0, 0});
+    tui.render_message(std::to_string(count) + " substitutions on " +
+                       std::to_string(changed) + " lines");
+    return count;
+}
+
+void Editor::show_message(const std::string& message) {
+    tui.render_message(message);
+}
+
+bool Editor::refuse_edit() {
+    if (!buffer.read_only()) {
+        return false;
+    }
+    tui.render_message("Read-only view (-R)");
+    return true;
+}
+
+bool Editor::open_file(const std::string& filepath) {
+    if (buffer.is_modified()) {
+        tui.render_message("No write since last change");
+        return false;
+    }
+    if (follower) {
+        stop_follow("");
+    }
+    store_cached_states();
+    journal.discard();
+    if (!buffer.open(filepath, [this] { wake(); })) {
+        if (!buffer.read_only()) {
+            journal.start(m_filepath);
+        }
+        tui.render_message("Cannot open " + filepath);
+        return false;
+    }
+    m_filepath = filepath;
+    language = &lex::language_for(filepath);
+    semantic.emplace(filepath, !buffer.guard().active && !buffer.read_only(),
+                     [this] { wake(); });
+    tui.set_filename(filepath);
+    cm.move_abs({0, 0, 0});
+    watch_disk();
+    load_cached_states();
+    if (!buffer.loading()) {
+        on_loaded();
+    }
+    attach_journal();
+    return true;
+}
+
+void Editor::poll_load(const bool wait) {
+    if (buffer.poll_load(wait)) {
+        on_loaded();
+    }
+}
+
+void Editor::on_loaded() {
+    loaded_version = buffer.is_modified() ? std::nullopt
+                                          : std::optional(buffer.version());
+    load_history();
+}
+
+void Editor::load_history() {
+    // hashing the text is the whole cost, huge files go without; edits made
+    // while loading would not match the history anyway
+    if (!buffer.guard().active && !buffer.is_modified() && !buffer.read_only()) {
+        buffer.load_undo(UndoFile::path_for(m_filepath));
+    }
+}
+
+void Editor::load_cached_states() {
+    loaded_version.reset();
+    seeded_states = 0;
+    if (const auto& key = buffer.cache_key()) {
+        highlight_states.seed(LineCache::load_states(m_filepath, *key));
+        seeded_states = highlight_states.states().size();
+    }
+}
+
+void Editor::store_cached_states() {
+    const auto& key = buffer.cache_key();
+    if (key && buffer.version() == loaded_version &&
+        highlight_states.states().size() > seeded_states) {
+        LineCache::store_states(m_filepath, *key, highlight_states.states());
+    }
+}
+
+void Editor::attach_journal() {
+    // a view has no edits to lose
+    if (buffer.read_only()) {
+        return;
+    }
+    if (Journal::recoverable(m_filepath)) {
+        tui.render_message("Found an edit journal for " + m_filepath +
+                           ": (r)ecover, (d)iscard, (q)uit");
+        int key;
+        while ((key = tui.get_char()) != 'r' && key != 'd' && key != 'q') {
+        }
+        if (key == 'r') {
+            // the records apply to the whole file
+            while (buffer.loading()) {
+                poll_load(true);
+            }
+            if (const auto applied = Journal::recover(m_filepath, buffer)) {
+                cm.move_abs(clamp_cursor(buffer, cm.get()));
+                journal.start(m_filepath);
+                journal.compact(buffer.snapshot());
+                tui.render_message("Recovered " + std::to_string(*applied) +
+                                   " changes, ':w' to keep them");
+                return;
+            }
+            tui.render_message("The journal does not match " + m_filepath +
+                               " any more: (d)iscard, (q)uit");
+            while ((key = tui.get_char()) != 'd' && key != 'q') {
+            }
+        }
+        if (key == 'q') {
+            // the journal is left for a later run
+            should_exit = true;
+            return;
+        }
+        tui.render_message("");
+    }
+    journal.start(m_filepath);
+}
+
+void Editor::start_grep(const regex::Regex& pattern,
+                        std::vector<std::string> paths) {
+    if (paths.empty()) {
+        paths.emplace_back(".");
+    }
+    grep.reset(); // joins the previous search
+    grep = std::make_unique<Grep>(pattern, paths, [this] { wake(); });
+    quickfix_pos = 0;
+    quickfix_started = false;
+}
+
+void Editor::cancel_grep() {
+    if (grep && grep->running()) {
+        grep->cancel();
+        tui.render_message("grep cancelled");
+    }
+}
+
+void Editor::toggle_follow() {
+    if (follower) {
+        stop_follow("Stopped following " + m_filepath);
+        return;
+    }
+    // the mapping ends where the file did when it was opened
+    if (refuse_edit()) {
+        return;
+    }
+    if (!loop.valid()) {
+        tui.render_message("Following needs epoll");
+        return;
+    }
+    // following starts where the load stopped
+    while (buffer.loading()) {
+        poll_load(true);
+    }
+    follower = std::make_unique<FileFollower>(m_filepath, buffer.loaded_bytes());
+    if (!follower->valid() || !loop.watch(follower->fd(), [this] { on_follow(); })) {
+        follower.reset();
+        tui.render_message("Cannot watch " + m_filepath);
+        return;
+    }
+    cm.move_abs({buffer.line_count() - 1, 0, 0});
+    tui.render_message("Following " + m_filepath + ", ':follow' to stop");
+    on_follow(); // whatever was written since the load
+}
+
+void Editor::on_follow() {
+    if (!follower) {
+        return;
+    }
+    std::string text;
+    bool continues = false;
+    const bool pinned = cm.row() + 1 == buffer.line_count();
+    switch (follower->read(text, continues)) {
+    case FileFollower::Event::Appended:
+        buffer.append_tail(text, continues);
+        if (pinned) {
+            cm.move_abs({buffer.line_count() - 1, 0, 0});
+        }
+        // a big burst is taken in a slice per wakeup, keys still get through
+        if (follower->behind()) {
+            loop.post([this] { on_follow(); });
+        }
+        break;
+    case FileFollower::Event::Truncated:
+        stop_follow(m_filepath + " was truncated, stopped following");
+        break;
+    case FileFollower::Event::Removed:
+        stop_follow(m_filepath + " was moved or deleted, stopped following");
+        break;
+    case FileFollower::Event::None:
+        break;
+    }
+}
+
+void Editor::stop_follow(const std::string& why) {
+    loop.unwatch(follower->fd());
+    follower.reset();
+    if (!why.empty()) {
+        tui.set_message(why);
+    }
+}
+
+void Editor::watch_disk() {
+    if (disk_watch) {
+        loop.unwatch(disk_watch->fd());
+    }
+    disk_changed = false;
+    disk_watch = std::make_unique<DiskWatch>(m_filepath);
+    if (!disk_watch->valid() || !loop.valid() ||
+        !loop.watch(disk_watch->fd(), [this] { on_disk_change(); })) {
+        disk_watch.reset();
+    }
+}
+
+void Editor::on_disk_change() {
+    // a save of ours lands as a rename too, it is synced before the check
+    finish_save();
+    const bool changed = disk_watch->changed();
+    // :follow takes in growth itself
+    if (!changed || (save && save->running()) || follower) {
+        return;
+    }
+    if (!DiskWatch::stamp_of(m_filepath).exists) {
+        disk_watch->sync();
+        tui.set_message("WARNING: " + m_filepath + " was removed from disk");
+        return;
+    }
+    if (!buffer.read_only() && (buffer.is_modified() || buffer.loading())) {
+        disk_changed = true;
+        tui.set_message("WARNING: " + m_filepath + " changed on disk, ':reload' to "
+                        "load it or ':w!' to overwrite it");
+        return;
+    }
+    reload_from_disk();
+}
+
+void Editor::reload_from_disk() {
+    if (buffer.read_only()) {
+        // pages of the old mapping may already show the new text: no diff,
+        // the file is mapped again
+        if (disk_watch) {
+            disk_watch->sync();
+        }
+        const Cursor cursor = cm.get();
+        if (!buffer.open(m_filepath, [this] { wake(); })) {
+            tui.set_message("Cannot read " + m_filepath);
+            return;
+        }
+        cm.move_abs(clamp_cursor(buffer, cursor));
+        tui.set_message("\"" + m_filepath + "\" reloaded");
+        return;
+    }
+    while (buffer.loading()) {
+        poll_load(true);
+    }
+    // synced first: a write that lands while reading is another change
+    if (disk_watch) {
+        disk_watch->sync();
+    }
+    auto lines = FileLoader::read_all(m_filepath);
+    if (!lines) {
+        tui.set_message("Cannot read " + m_filepath);
+        return;
+    }
+    if (lines->empty()) {
+        lines->emplace_back(); // an empty file is one empty row
+    }
+    disk_changed = false;
+
+    const BufferSnapshot text = buffer.snapshot();
+    std::vector<std::string_view> old_rows(text.line_count());
+    for (std::size_t row = 0; row < old_rows.size(); ++row) {
+        old_rows[row] = text.line(row);
+    }
+    const std::vector<std::string_view> new_rows(lines->begin(), lines->end());
+    const auto hunks = diff::lines(old_rows, new_rows);
+    if (hunks.empty()) {
+        buffer.set_modified(false);
+        return;
+    }
+
+    // bottom up, so the rows above each hunk are still where the diff saw
+    // them; one undo step brings back what was there before
+    const Cursor cursor = cm.get();
+    const std::size_t top = viewport.get_view_offset();
+    buffer.begin_undo_group(cursor);
+    for (auto hunk = hunks.rbegin(); hunk != hunks.rend(); ++hunk) {
+        const auto first = lines->begin() + static_cast<std::ptrdiff_t>(hunk->new_row);
+        buffer.splice_lines(
+            hunk->old_row, hunk->removed,
+            {std::make_move_iterator(first),
+             std::make_move_iterator(first + static_cast<std::ptrdiff_t>(hunk->inserted))});
+    }
+    buffer.end_undo_group();
+    buffer.set_modified(false);
+    journal.rebase();
+
+    viewport.set_view_offset(
+        std::min(diff::map_row(top, hunks), buffer.line_count() - 1));
+    cm.move_abs(clamp_cursor(
+        buffer, {diff::map_row(cursor.row, hunks), cursor.col, cursor.original_col}));
+    tui.set_message("\"" + m_filepath + "\" reloaded, " +
+                    std::to_string(hunks.size()) + " blocks changed");
+}
+
+void Editor::check_truncated() {
+    if (buffer.read_only() && buffer.truncated()) {
+        reload_from_disk();
+    }
+}
+
+void Editor::quickfix_next(const bool reverse) {
+    if (!grep) {
+        tui.render_message("No quickfix list");
+        return;
+    }
+    const std::size_t total = grep->count();
+    if (total == 0) {
+        tui.render_message(grep->running() ? "No matches yet" : "No matches");
+        return;
+    }
+
+    if (!quickfix_started) {
+        quickfix_started = true;
+    } else if (reverse) {
+        if (quickfix_pos == 0) {
+            tui.render_message("At the first match");
+            return;
+        }
+        --quickfix_pos;
+    } else {
+        if (quickfix_pos + 1 >= total) {
+            tui.render_message(grep->running() ? "No more matches yet"
+                                               : "At the last match");
+            return;
+        }
+        ++quickfix_pos;
+    }
+
+    const auto entry = grep->entry(quickfix_pos);
+    std::error_code ec;
+    if (!std::filesystem::equivalent(entry->path, m_filepath, ec) &&
+        !open_file(entry->path)) {
+        return;
+    }
+    cm.move_abs(clamp_cursor(buffer, {entry->row, entry->col, entry->col}));
+    tui.render_message("(" + std::to_string(quickfix_pos + 1) + " of " +
+                       std::to_string(total) + ") " + entry->text);
+}
+
 Buffer& Editor::get_buffer() {
     return buffer;
 }
@@ -141,11 +912,64 @@ void Editor::set_should_exit(const bool value) {
 }
 
 void Editor::update_view() {
+    // a replayed macro is drawn once, after it finishes
+    if (replaying) {
+        return;
+    }
     const auto model_cursor = cm.get();
     viewport.adjust_viewport(model_cursor);
     const auto screen_cursor = viewport.model_to_screen(model_cursor);
-    tui.render_file(screen_cursor, buffer, viewport.get_view_offset(),
-                    m_visual_start, m_visual_end);
+
+    std::string status = buffer.guard().reason;
+    if (buffer.read_only()) {
+        status += status.empty() ? "[view]" : " [view]";
+    }
+    if (recording) {
+        status += (status.empty() ? "recording @" : " recording @") +
+                  std::string(1, static_cast<char>(*recording));
+    }
+    if (matches.active()) {
+        const auto ordinal = matches.ordinal_at(model_cursor);
+        status += (status.empty() ? "[" : " [") +
+                  (ordinal ? std::to_string(*ordinal) : "-") + "/" +
+                  std::to_string(matches.count()) +
+                  (matches.complete() ? "]" : "...]");
+    }
+    if (disk_changed) {
+        status += status.empty() ? "[changed on disk]" : " [changed on disk]";
+    }
+    if (buffer.loading()) {
+        status += (status.empty() ? "[loading " : " [loading ") +
+                  std::to_string(buffer.line_count()) + " lines, " +
+                  std::to_string(buffer.load_percent()) + "%]";
+    }
+    if (save) {
+        const std::size_t total = std::max<std::size_t>(save->bytes_total(), 1);
+        status += (status.empty() ? "[saving " : " [saving ") +
+                  std::to_string(save->bytes_written() * 100 / total) + "%]";
+    }
+    if (grep) {
+        status += (status.empty() ? "[grep: " : " [grep: ") +
+                  std::to_string(grep->count()) + " in " +
+                  std::to_string(grep->files_searched()) + " files" +
+                  (grep->running()           ? "..."
+                   : grep->was_cancelled() ? ", cancelled"
+                                           : "") +
+                  "]";
+    }
+    tui.set_status(status);
+
+    const auto [first_row, last_row] = viewport.getVisibleRange();
+    // guarded files have very long lines, only their highlighted prefix is searched
+    hlsearch.update(buffer, first_row, last_row, buffer.guard().highlight_cols);
+
+    if (!buffer.loading()) {
+        semantic->request(buffer);
+    }
+    const auto semantic_result = semantic->latest();
+    tui.render_file(screen_cursor, buffer, *language, highlight_states,
+                    viewport.get_view_offset(), m_visual_start, m_visual_end,
+                    semantic_result.get(), &hlsearch);
 }
 
 bool Editor::execute(
@@ -158,15 +982,304 @@ bool Editor::execute(
     return false;
 }
 
+void Editor::paste(const std::string_view text) {
+    if (text.empty() || refuse_edit()) {
+        return;
+    }
+    buffer.begin_undo_group(cm.get());
+    Cursor end = buffer.insert_text(cm.get(), text);
+    buffer.end_undo_group();
+    // move_abs stops on the last character, insert mode continues past it
+    cm.move_abs(clamp_cursor(buffer, end));
+    if (curr_mode == Mode::Insert) {
+        insert_draft.text += text;
+        if (end.col > cm.col()) {
+            cm.move_dir(Direction::Right);
+        }
+    }
+    buffer.move_cursor(cm);
+}
+
+bool Editor::dispatch(KeyDispatcher& dispatcher, const int key) {
+    KeyAction action = nullptr;
+    auto result = dispatcher.feed(key, action);
+    if (result == KeyDispatcher::Result::Flush) {
+        action(*this);
+        result = dispatcher.feed(key, action);
+    }
+    if (result == KeyDispatcher::Result::Run) {
+        action(*this);
+    }
+    return result == KeyDispatcher::Result::Pending;
+}
+
+KeyDispatcher* Editor::active_dispatcher() {
+    switch (curr_mode) {
+    case Mode::Normal:
+        return &normal_dispatch;
+    case Mode::Visual:
+        return &visual_dispatch;
+    default:
+        return nullptr;
+    }
+}
+
+void Editor::expire_sequence() {
+    if (KeyDispatcher* dispatcher = active_dispatcher()) {
+        if (const KeyAction action = dispatcher->expire()) {
+            m_count = pending_count;
+            buffer.begin_undo_group(cm.get());
+            action(*this);
+            buffer.end_undo_group();
+        }
+    }
+    pending_count = 0;
+    m_count = 0;
+}
+
+int Editor::read_key(const int timeout_ms) {
+    if (replaying) {
+        // a macro that ends inside a prompt abandons it
+        return next_macro_key().value_or(NCKEY_ESC);
+    }
+    const int key = tui.get_char(timeout_ms);
+    if (recording && key != 0) {
+        recorded.push_back(key);
+    }
+    return key;
+}
+
+int Editor::poll_key() {
+    if (replaying) {
+        return 0;
+    }
+    const int key = tui.poll_char();
+    if (recording && key != 0) {
+        recorded.push_back(key);
+    }
+    return key;
+}
+
+std::string Editor::read_paste() {
+    // recorded as the text followed by a closing NCKEY_PASTE
+    std::string text;
+    if (replaying) {
+        std::optional<int> key;
+        while ((key = next_macro_key()) && *key != NCKEY_PASTE) {
+            text.push_back(static_cast<char>(*key));
+        }
+        return text;
+    }
+    text = tui.read_paste();
+    if (recording) {
+        for (const char c : text) {
+            recorded.push_back(static_cast<unsigned char>(c));
+        }
+        recorded.push_back(NCKEY_PASTE);
+    }
+    return text;
+}
+
+std::optional<int> Editor::next_macro_key() {
+    while (!macro_frames.empty()) {
+        MacroFrame& frame = macro_frames.back();
+        if (frame.pos < frame.keys->size()) {
+            return (*frame.keys)[frame.pos++];
+        }
+        if (--frame.repeats > 0) {
+            frame.pos = 0;
+        } else {
+            macro_frames.pop_back();
+        }
+    }
+    return std::nullopt;
+}
+
+void Editor::await_register(const char command) {
+    if (replaying && command == 'q') {
+        return; // a replay does not re-record
+    }
+    if (command == 'q' && recording) {
+        stop_recording();
+        return;
+    }
+    register_command = command;
+    register_count = count_or(1);
+}
+
+void Editor::start_recording(const int name) {
+    recording = name;
+    recorded.clear();
+}
+
+void Editor::stop_recording() {
+    // the "q" that ended the recording was recorded too
+    if (!recorded.empty()) {
+        recorded.pop_back();
+    }
+    macros[*recording] = std::move(recorded);
+    recorded.clear();
+    recording.reset();
+}
+
+void Editor::replay_macro(const int name, const std::size_t count) {
+    const auto it = macros.find(name);
+    if (it == macros.end() || it->second.empty()) {
+        tui.render_message("Register is empty");
+        return;
+    }
+    if (recording && *recording == name) {
+        tui.render_message("Register is being recorded");
+        return;
+    }
+    if (macro_frames.size() >= max_macro_depth) {
+        macro_frames.clear(); // recursive macro, stop the whole replay
+        tui.render_message("Macro nested too deeply");
+        return;
+    }
+    last_macro = name;
+    macro_frames.push_back({&it->second, 0, count});
+    if (replaying) {
+        return; // a nested @, the running replay continues with it
+    }
+
+    // keys are applied back to back: update_view is skipped and the terminal
+    // is not flushed until the end, every edit lands in one undo group
+    replaying = true;
+    tui.hold_render(true);
+    buffer.begin_undo_group(cm.get());
+    while (!should_exit) {
+        const auto key = next_macro_key();
+        if (!key) {
+            break;
+        }
+        handle_key(*key);
+        run_prompt();
+    }
+    buffer.end_undo_group();
+    macro_frames.clear();
+    tui.hold_render(false);
+    replaying = false;
+}
+
+void Editor::run_prompt() {
+    // Command and search modes use their own input loop.
+    if (curr_mode == Mode::Command) {
+        buffer.begin_undo_group(cm.get());
+        command_mode();
+        buffer.end_undo_group();
+    } else if (curr_mode == Mode::Search) {
+        search_mode();
+    }
+}
+
+void Editor::handle_key(const int input) {
+    if (input == NCKEY_PASTE) {
+        if (curr_mode == Mode::Normal || curr_mode == Mode::Insert) {
+            paste(read_paste());
+        } else {
+            read_paste(); // nothing to paste into
+        }
+        return;
+    }
+
+    if (register_command != 0) {
+        const char command = std::exchange(register_command, 0);
+        const bool named = (input >= 'a' && input <= 'z') || (input >= '0' && input <= '9');
+        if (command == 'q' && named) {
+            start_recording(input);
+        } else if (command == '@' && (named || input == '@')) {
+            replay_macro(input == '@' ? last_macro : input, register_count);
+        }
+        return;
+    }
+
+    switch (curr_mode) {
+    case Mode::Normal: {
+        // "0" is a motion of its own unless it continues a count
+        if (!normal_dispatch.pending() &&
+            ((input >= '1' && input <= '9') || (input == '0' && pending_count > 0))) {
+            constexpr std::size_t max_count = 999'999'999;
+            pending_count = std::min(pending_count * 10 + static_cast<std::size_t>(input - '0'),
+                                     max_count);
+            return;
+        }
+        tui.set_message("");
+        m_count = pending_count;
+        buffer.begin_undo_group(cm.get());
+        const bool pending = dispatch(normal_dispatch, input);
+        buffer.end_undo_group();
+        // the count waits for the rest of a sequence like "dd"
+        if (!pending) {
+            pending_count = 0;
+        }
+        m_count = 0;
+        break;
+    }
+    case Mode::Insert:
+        insert_mode(input);
+        tui.set_message(curr_mode == Mode::Insert ? "-- INSERT --" : "");
+        break;
+    case Mode::Visual:
+        buffer.begin_undo_group(cm.get());
+        dispatch(visual_dispatch, input);
+        buffer.end_undo_group();
+        break;
+    case Mode::Command:
+    case Mode::Search:
+        break;
+    }
+}
+
+void Editor::on_input() {
+    check_truncated();
+    int input;
+    while ((input = poll_key()) != 0) {
+        handle_key(input);
+        run_prompt(); // a key that opened a prompt, it reads its own keys
+    }
+    const KeyDispatcher* dispatcher = active_dispatcher();
+    loop.arm_timer(sequence_timer, dispatcher && dispatcher->pending()
+                                       ? sequence_timeout_ms
+                                       : 0);
+}
+
+void Editor::wake() {
+    // one queued wakeup at a time, the frame after it shows everything
+    if (!wake_posted.exchange(true)) {
+        loop.post([this] { wake_posted = false; });
+    }
+}
+
 void Editor::run() {
-    int input = 0;
-    int last_input = 0;
     auto last_mode = Mode::Normal;
+    NotcursesTUI::set_cursor_mode(CursorMode::Block);
     // Initial render.
     update_view();
 
+    // keys, the pending-sequence timeout and background jobs (grep results,
+    // semantic highlighting) all wake the same wait, nothing is polled
+    const bool evented =
+        loop.valid() && loop.watch(tui.input_fd(), [this] { on_input(); });
+    sequence_timer = loop.add_timer([this] { expire_sequence(); });
+    watch_disk();
+    // without the loop nothing would wake up for the rest of the file
+    while (!evented && buffer.loading()) {
+        buffer.poll_load(true);
+    }
+    if (!buffer.loading()) {
+        on_loaded();
+    }
+    attach_journal();
+
     while (true) {
-        if (should_exit) {
+        finish_save();
+        // a checkpoint of part of the file would cut off the rest
+        if (!buffer.loading() && journal.wants_checkpoint()) {
+            journal.compact(buffer.snapshot());
+        }
+        if (should_exit && !(save && save->running())) {
+            // ":wq" exits once its save has landed
             if (buffer.is_modified()) {
                 tui.render_message("Changes not written, use ':w' or ':q!'");
                 should_exit = false;
@@ -181,46 +1294,21 @@ void Editor::run() {
             viewport.update_term_size(curr_term_size);
         }
 
-        switch (curr_mode) {
-        case Mode::Normal:
-        case Mode::Insert:
-        case Mode::Visual:
-            input = tui.get_char(); // Use NotcursesTUI’s blocking input
-            break;
-        case Mode::Command:
-            input = 0; // Command mode uses its own input loop.
-            last_input = 0;
-            break;
-        }
-
-        switch (curr_mode) {
-        case Mode::Normal:
-            NotcursesTUI::set_cursor_mode(CursorMode::Block);
-            tui.render_message("");
-            if (!execute(Keybindings::normal_keys, int_to_str(input))) {
-                if (execute(Keybindings::normal_keys,
-                            int_to_str(last_input) + int_to_str(input))) {
-                    input = 0;
-                    last_input = 0;
-                }
+        if (evented) {
+            if (loop.wait() == 0) {
+                continue; // interrupted by a signal
             }
-            break;
-        case Mode::Insert:
-            insert_mode(input);
-            NotcursesTUI::set_cursor_mode(CursorMode::Bar);
-            tui.render_message("-- INSERT --");
-            break;
-        case Mode::Command:
-            command_mode();
-            break;
-        case Mode::Visual:
-            if (!execute(Keybindings::visual_keys, int_to_str(input))) {
-                execute(Keybindings::visual_keys,
-                        int_to_str(last_input) + int_to_str(input));
-            }
-            break;
+        } else {
+            const int key = read_key();
+            check_truncated();
+            handle_key(key);
+            run_prompt();
+            on_input();
         }
-        last_input = input;
+
+        poll_load();
+        check_truncated();
+
         // Update the cursor shape if the mode has changed.
         if (curr_mode != last_mode) {
             if (curr_mode == Mode::Insert) {
@@ -232,4 +1320,6 @@ void Editor::run() {
         }
         update_view();
     }
+    store_cached_states();
+    journal.discard(); // a clean exit leaves nothing to recover
 }
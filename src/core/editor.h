@@ -1,48 +1,208 @@
 #pragma once
 
+#include "../keybindings/keymap.h"
+#include "../utils/event_loop.h"
 #include "../utils/log.h"
+#include "../utils/thread_pool.h"
 #include "cursor.h"
 #include "editor.h"
 #include "buffer.h"
+#include "change.h"
+#include "disk_watch.h"
+#include "follow.h"
+#include "grep.h"
+#include "journal.h"
+#include "save.h"
+#include "lex.h"
+#include "match_index.h"
+#include "search_layer.h"
+#include "semantic.h"
 #include "tui.h"
 #include "viewportmanager.h"
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 enum class Mode {
     Normal,
     Insert,
     Visual,
     Command,
+    Search,
 };
 
 class Editor {
 private:
     Mode curr_mode = Mode::Normal;
     Logger logger = Logger("../logfile.txt");
+    // before everything that posts to it from another thread (the loader,
+    // background jobs), so it outlives them all
+    EventLoop loop;
+    int sequence_timer = -1;
+    std::atomic<bool> wake_posted{false};
+    Buffer buffer; // before the TUI, which sizes itself from the first rows
     NotcursesTUI tui;
     CursorManager cm;
     ViewportManager viewport;
-    Buffer buffer;
     std::string m_filepath;
+    const lex::Language* language;
+    lex::StateCache highlight_states;
+    // buffer version once the load completed, if the text was still the
+    // file as read; and how many highlight states came from the line cache
+    std::optional<std::uint64_t> loaded_version;
+    std::size_t seeded_states = 0;
     bool should_exit;
+    std::optional<SemanticHighlighter> semantic; // rebuilt per opened file
+    ThreadPool pool;
+    MatchIndex matches; // of the last confirmed search pattern
+    SearchLayer hlsearch;
+
+    std::unique_ptr<BackgroundSave> save; // the running or last :w
+    Journal journal;
+    std::unique_ptr<FileFollower> follower; // while :follow is on
+    std::unique_ptr<DiskWatch> disk_watch;
+    // the file changed on disk while the buffer had unsaved changes
+    bool disk_changed = false;
+    std::unique_ptr<Grep> grep; // last :grep, doubles as the quickfix list
+    std::size_t quickfix_pos = 0;
+    bool quickfix_started = false;
 
     std::optional<Cursor> m_visual_start;
     std::optional<Cursor> m_visual_end;
 
+    KeyDispatcher normal_dispatch;
+    KeyDispatcher visual_dispatch;
+    std::size_t pending_count = 0; // digits typed before a normal-mode key
+    std::size_t m_count = 0;       // count of the binding being executed
+
+    std::string search_pattern;
+    bool search_forward = true;
+
+    Change last_change;  // repeated by "."
+    Change insert_draft; // the insert session in progress
+
+    // q{reg} / @{reg}: keys as they were read, including prompt and paste input
+    struct MacroFrame {
+        const std::vector<int>* keys;
+        std::size_t pos;
+        std::size_t repeats;
+    };
+    static constexpr std::size_t max_macro_depth = 1000;
+    std::unordered_map<int, std::vector<int>> macros;
+    std::optional<int> recording; // register being recorded
+    std::vector<int> recorded;
+    char register_command = 0; // 'q' or '@' while its register name is awaited
+    std::size_t register_count = 0;
+    int last_macro = 0;
+    std::vector<MacroFrame> macro_frames; // nested @ calls
+    bool replaying = false;
+
 public:
-    explicit Editor(const std::string& filepath);
+    // read_only (-R) maps the file and refuses every edit, for looking
+    // through files too big to load
+    explicit Editor(const std::string& filepath, bool read_only = false);
 
     // Mode-handling methods:
     void set_mode(Mode mode);
     void set_should_exit(bool value);
     void set_visual_end(const Cursor& cursor);
+    // count typed before the current binding, or fallback without one
+    std::size_t count_or(std::size_t fallback) const;
     void insert_mode(int input);
+    // "i" and "a"
+    void start_insert(bool append);
+    // one key in normal, insert or visual mode, without drawing
+    void handle_key(int input);
+    // the terminal fd is readable: every queued key, prompts included
+    void on_input();
+    // thread-safe: a background job has something new to draw
+    void wake();
+    // feeds a key to the trie, running what it completes; true while pending
+    bool dispatch(KeyDispatcher& dispatcher, int key);
+    KeyDispatcher* active_dispatcher();
+    // a pending key sequence timed out
+    void expire_sequence();
+    // all input goes through these: replayed keys come from the running
+    // macro, terminal keys are recorded while a register is being recorded
+    int read_key(int timeout_ms = -1);
+    int poll_key();
+    std::string read_paste();
+    std::optional<int> next_macro_key();
+    // "q" and "@": the next key names the register
+    void await_register(char command);
+    void start_recording(int name);
+    void stop_recording();
+    // runs the macro `count` times without drawing, as one undo step
+    void replay_macro(int name, std::size_t count);
+    // the ':' or search prompt a key switched to, if any
+    void run_prompt();
+    // bracketed paste: the whole payload is one edit and one undo step
+    void paste(std::string_view text);
     void command_mode();
+    // incremental '/' and '?' prompt, moves the cursor as the pattern grows
+    void search_mode();
+    void start_search(bool forward);
+    void search_next(bool reverse);
+
+    void undo();
+    void redo();
+
+    // changes that "." can repeat
+    void delete_lines(std::size_t count);
+    void delete_selection();
+    void repeat_change();
+    // replaces matches in rows [first, last) on the thread pool and applies
+    // them as one edit; returns the number of replacements
+    std::size_t substitute(const regex::Regex& pattern,
+                           std::string_view replacement, std::size_t first,
+                           std::size_t last, bool global);
+    void show_message(const std::string& message);
+    // true, with a message, if the buffer is a read-only view
+    bool refuse_edit();
+
+    // replaces the buffer with another file, refused if there are unsaved changes
+    bool open_file(const std::string& filepath);
+    // :follow, `less +F`: rows appended to the file show up as they are
+    // written, the view stays at the end while the cursor is on the last row
+    void toggle_follow();
+    void on_follow();
+    void stop_follow(const std::string& why);
+    // starts watching m_filepath for changes made by other programs
+    void watch_disk();
+    void on_disk_change();
+    // :reload, patches in only the rows that differ from the file on disk
+    // as one undo step; the cursor and view stay on the same text
+    void reload_from_disk();
+    // a view (-R) of a file cut short in place is opened again before
+    // anything reads the rows past its new end, which would raise SIGBUS
+    void check_truncated();
+    void start_grep(const regex::Regex& pattern, std::vector<std::string> paths);
+    void cancel_grep();
+    // moves to the next/previous :grep result, opening its file if needed
+    void quickfix_next(bool reverse);
 
-    void write_file();
+    // :w, written on a worker; editing continues meanwhile. Refused while
+    // the file has changed on disk since, unless forced (:w!)
+    void write_file(bool force = false);
+    // a finished save marks the buffer saved if nothing changed since
+    void finish_save();
+    // offers to replay a journal left by a crash, then starts a new one
+    void attach_journal();
+    // takes in the rows the loader has read; `wait` blocks for the next batch
+    void poll_load(bool wait = false);
+    // the whole file is in
+    void on_loaded();
+    // undo history saved with the file by an earlier session
+    void load_history();
+    // lexer states from the line cache, and back into it while the text is
+    // still the file as loaded
+    void load_cached_states();
+    void store_cached_states();
 
     void run();
 
@@ -0,0 +1,91 @@
+#include "follow.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FileFollower::FileFollower(const std::string& path, const std::uint64_t offset)
+    : offset(offset) {
+    file_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    // deletion shows up as IN_ATTRIB: IN_DELETE_SELF waits for our own fd
+    if (file_fd < 0 || inotify_fd < 0 ||
+        ::inotify_add_watch(inotify_fd, path.c_str(),
+                            IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF) < 0) {
+        if (file_fd >= 0) {
+            ::close(file_fd);
+        }
+        if (inotify_fd >= 0) {
+            ::close(inotify_fd);
+        }
+        file_fd = inotify_fd = -1;
+        return;
+    }
+    // an empty file is one empty row, which the first text fills in
+    char last = '\n';
+    open_row = offset == 0 ||
+               (::pread(file_fd, &last, 1, static_cast<off_t>(offset - 1)) == 1 &&
+                last != '\n');
+}
+
+FileFollower::~FileFollower() {
+    if (file_fd >= 0) {
+        ::close(file_fd);
+        ::close(inotify_fd);
+    }
+}
+
+bool FileFollower::valid() const {
+    return file_fd >= 0;
+}
+
+int FileFollower::fd() const {
+    return inotify_fd;
+}
+
+FileFollower::Event FileFollower::read(std::string& text, bool& continues) {
+    // the events only say that something happened, the size says what
+    alignas(inotify_event) char events[4096];
+    ssize_t n;
+    while ((n = ::read(inotify_fd, events, sizeof(events))) > 0) {
+        for (const char* p = events; p < events + n;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(p);
+            if (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) {
+                removed = true;
+            }
+            p += sizeof(inotify_event) + event->len;
+        }
+    }
+
+    struct stat st {};
+    if (::fstat(file_fd, &st) != 0) {
+        return Event::Removed;
+    }
+    const auto size = static_cast<std::uint64_t>(st.st_size);
+    if (size < offset) {
+        return Event::Truncated;
+    }
+    removed = removed || st.st_nlink == 0;
+
+    // what was written before a rename or delete is still taken in
+    more = false;
+    if (size > offset) {
+        text.resize(static_cast<std::size_t>(std::min<std::uint64_t>(size - offset, max_read)));
+        const ssize_t got =
+            ::pread(file_fd, text.data(), text.size(), static_cast<off_t>(offset));
+        text.resize(got > 0 ? static_cast<std::size_t>(got) : 0);
+        if (!text.empty()) {
+            continues = open_row;
+            open_row = text.back() != '\n';
+            offset += text.size();
+            more = offset < size || removed;
+            return Event::Appended;
+        }
+    }
+    return removed ? Event::Removed : Event::None;
+}
+
+bool FileFollower::behind() const {
+    return more;
+}
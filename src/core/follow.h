@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ `less +F` for the open file. inotify reports writes to it; each read then
+ takes only the bytes appended since the last one (from an fd kept open, so
+ a rename does not lose them), the rows already in the buffer are never
+ read again. A file that shrinks or goes away ends the follow, a rewrite in
+ place cannot be told apart from growth in any cheaper way.
+*/
+
+class FileFollower {
+private:
+    int inotify_fd = -1;
+    int file_fd = -1;
+    std::uint64_t offset; // bytes of the file already in the buffer
+    // the file does not end in '\n', appended text continues its last row
+    bool open_row = false;
+    bool removed = false; // seen going away, the rest is read first
+    bool more = false;
+
+public:
+    // an appended burst is taken in over several reads of this much
+    static constexpr std::size_t max_read = 4 << 20;
+
+    enum class Event {
+        None,      // nothing new
+        Appended,  // `text` was appended
+        Truncated, // the file is shorter than what was read of it
+        Removed,   // deleted or renamed away
+    };
+
+    // follows path from `offset`, the number of bytes already loaded
+    FileFollower(const std::string& path, std::uint64_t offset);
+    ~FileFollower();
+
+    FileFollower(const FileFollower&) = delete;
+    FileFollower& operator=(const FileFollower&) = delete;
+
+    bool valid() const;
+    // readable when inotify has events
+    int fd() const;
+
+    // drains the events, then reads up to max_read appended bytes into text;
+    // `continues` is set when its first line belongs to the last row
+    Event read(std::string& text, bool& continues);
+    // the last read stopped at max_read, read again before waiting
+    bool behind() const;
+};
@@ -0,0 +1,229 @@
+#include "grep.h"
+#include "../utils/simd_scan.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+Grep::Grep(const regex::Regex& pattern, const std::vector<std::string>& roots,
+           std::function<void()> on_progress, std::size_t threads)
+    : pattern(pattern), on_progress(std::move(on_progress)) {
+    for (const auto& root : roots) {
+        todo.emplace_back(root);
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    live = threads;
+    workers.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(&Grep::work, this);
+    }
+}
+
+Grep::~Grep() {
+    cancel();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void Grep::cancel() {
+    {
+        std::lock_guard lock(mtx);
+        cancelled = true;
+    }
+    cv.notify_all();
+}
+
+bool Grep::running() const {
+    return live > 0;
+}
+
+bool Grep::was_cancelled() const {
+    return cancelled;
+}
+
+std::size_t Grep::count() const {
+    std::lock_guard lock(results_mtx);
+    return results.size();
+}
+
+std::size_t Grep::files_searched() const {
+    return searched;
+}
+
+std::optional<QuickfixEntry> Grep::entry(const std::size_t index) const {
+    std::lock_guard lock(results_mtx);
+    if (index >= results.size()) {
+        return std::nullopt;
+    }
+    return results[index];
+}
+
+void Grep::work() {
+    regex::Matcher matcher(pattern);
+    std::vector<fs::path> found;
+    std::vector<QuickfixEntry> hits;
+    while (true) {
+        fs::path path;
+        {
+            std::unique_lock lock(mtx);
+            cv.wait(lock, [this] { return cancelled || !todo.empty() || busy == 0; });
+            // an empty queue with nobody expanding a directory means done
+            if (cancelled || todo.empty()) {
+                break;
+            }
+            path = std::move(todo.front());
+            todo.pop_front();
+            ++busy;
+        }
+
+        found.clear();
+        hits.clear();
+        std::error_code ec;
+        const auto status = fs::status(path, ec);
+        if (!ec && fs::is_directory(status)) {
+            expand(path, found);
+        } else if (!ec && fs::is_regular_file(status)) {
+            search_file(path, matcher, hits);
+            ++searched;
+        }
+
+        if (!hits.empty()) {
+            {
+                std::lock_guard lock(results_mtx);
+                results.insert(results.end(), std::make_move_iterator(hits.begin()),
+                               std::make_move_iterator(hits.end()));
+            }
+            if (on_progress) {
+                on_progress();
+            }
+        }
+        {
+            std::lock_guard lock(mtx);
+            todo.insert(todo.end(), std::make_move_iterator(found.begin()),
+                        std::make_move_iterator(found.end()));
+            --busy;
+        }
+        cv.notify_all();
+    }
+    const bool last = --live == 0;
+    cv.notify_all();
+    if (last && on_progress) {
+        on_progress();
+    }
+}
+
+void Grep::expand(const fs::path& dir, std::vector<fs::path>& out) const {
+    std::error_code ec;
+    fs::directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        if (it->path().filename().string().starts_with('.')) {
+            continue;
+        }
+        std::error_code type_ec;
+        const auto type = it->symlink_status(type_ec).type();
+        if (!type_ec &&
+            (type == fs::file_type::directory || type == fs::file_type::regular)) {
+            out.push_back(it->path());
+        }
+    }
+}
+
+void Grep::search_file(const fs::path& path, regex::Matcher& matcher,
+                       std::vector<QuickfixEntry>& out) const {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return;
+    }
+    const auto size = static_cast<std::size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    ::madvise(map, size, MADV_SEQUENTIAL);
+
+    const char* data = static_cast<const char*>(map);
+    const char* end = data + size;
+    const std::string name = path.string();
+    const auto add = [&](const std::size_t row, const char* line,
+                         const char* line_end, const std::size_t col) {
+        if (line_end > line && line_end[-1] == '\r') {
+            --line_end;
+        }
+        const auto length = std::min(static_cast<std::size_t>(line_end - line), max_text);
+        out.push_back({name, row, col, std::string(line, length)});
+    };
+    const auto line_end_of = [&](const char* p) {
+        const auto* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        return nl ? nl : end;
+    };
+
+    // a NUL near the start marks a binary file
+    if (std::memchr(data, '\0', std::min<std::size_t>(size, 8192)) != nullptr) {
+        ::munmap(map, size);
+        return;
+    }
+
+    // the column of the first match in a line, if there is one
+    const auto first_match = [&](const char* line,
+                                 const char* line_end) -> std::optional<std::size_t> {
+        const std::string_view text(line, static_cast<std::size_t>(line_end - line));
+        if (!matcher.contains(text)) {
+            return std::nullopt;
+        }
+        const auto match = matcher.find_first(text, 0, SIZE_MAX);
+        return match ? std::optional(match->start) : std::nullopt;
+    };
+
+    if (const std::string& required = pattern.required(); !required.empty()) {
+        // jump from hit to hit of a string every match contains, rows are
+        // counted only over the skipped bytes; a plain literal is the match
+        const bool literal = pattern.literal().has_value();
+        std::size_t row = 0;
+        const char* counted = data;
+        const char* p = data;
+        while (p < end && !cancelled) {
+            const char* hit = scan::find(p, end, required);
+            if (hit == end) {
+                break;
+            }
+            row += static_cast<std::size_t>(std::count(counted, hit, '\n'));
+            counted = hit;
+            const auto* nl = static_cast<const char*>(::memrchr(data, '\n', hit - data));
+            const char* line = nl ? nl + 1 : data;
+            const char* line_end = line_end_of(hit);
+            if (literal) {
+                add(row, line, line_end, static_cast<std::size_t>(hit - line));
+            } else if (const auto col = first_match(line, line_end)) {
+                add(row, line, line_end, *col);
+            }
+            p = line_end;
+        }
+    } else {
+        std::size_t row = 0;
+        for (const char* line = data; line < end; ++row) {
+            if ((row & 0xffff) == 0 && cancelled) {
+                break;
+            }
+            const char* line_end = line_end_of(line);
+            if (const auto col = first_match(line, line_end)) {
+                add(row, line, line_end, *col);
+            }
+            line = line_end + 1;
+        }
+    }
+    ::munmap(map, size);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "../utils/regex.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ Background multi-file search for :grep.
+ Workers share a queue of paths: directories are expanded into the queue, so
+ the walk itself is parallel, and files are mmapped and searched in place.
+ Literal patterns are located with the SIMD substring scan over the whole
+ mapping, only the lines around hits are split out; a regex that requires
+ some literal is scanned for that the same way and only the lines holding it
+ run through the DFA. Results are appended per file and can be read while
+ the search is still running.
+*/
+
+struct QuickfixEntry {
+    std::string path;
+    std::size_t row;
+    std::size_t col;
+    std::string text; // the matching line, cut to max_text
+};
+
+class Grep {
+private:
+    static constexpr std::size_t max_text = 200;
+
+    regex::Regex pattern;
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<std::filesystem::path> todo;
+    std::size_t busy = 0; // workers holding a path taken from todo
+    std::atomic<bool> cancelled{false};
+    std::atomic<std::size_t> live{0};
+    std::atomic<std::size_t> searched{0};
+
+    mutable std::mutex results_mtx;
+    std::vector<QuickfixEntry> results;
+    std::function<void()> on_progress;
+
+    void work();
+    void expand(const std::filesystem::path& dir,
+                std::vector<std::filesystem::path>& out) const;
+    void search_file(const std::filesystem::path& path, regex::Matcher& matcher,
+                     std::vector<QuickfixEntry>& out) const;
+
+public:
+    // searches files and directory trees under `roots`, skipping hidden
+    // entries, symlinks and binary files; on_progress is called from the
+    // workers when results are added and when the search ends
+    Grep(const regex::Regex& pattern, const std::vector<std::string>& roots,
+         std::function<void()> on_progress = {}, std::size_t threads = 0);
+    ~Grep();
+
+    Grep(const Grep&) = delete;
+    Grep& operator=(const Grep&) = delete;
+
+    // workers stop after the file they are on
+    void cancel();
+    bool running() const;
+    bool was_cancelled() const;
+
+    std::size_t count() const;
+    std::size_t files_searched() const;
+    std::optional<QuickfixEntry> entry(std::size_t index) const;
+};
@@ -0,0 +1,404 @@
+#include "journal.h"
+#include "../utils/file_io.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+#include <sys/stat.h>
+#include <tuple>
+#include <unistd.h>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+/*
+ Layout, native byte order (the journal never leaves the machine):
+   header:  "CURSEYJ1", u64 base size, i64 base mtime (ns)
+   record:  u8 kind, u64 row, u64 removed, u64 count,
+            count x (u32 length, bytes), u32 FNV-1a of the record so far
+ A checkpoint ('C') replaces every row; it is only ever the first record.
+ A torn or corrupt record ends the replay, everything before it applies.
+*/
+
+namespace {
+
+constexpr std::string_view magic = "CURSEYJ1";
+constexpr std::size_t header_size = 8 + 8 + 8;
+constexpr char edit_record = 'E';
+constexpr char checkpoint_record = 'C';
+
+struct Fnv {
+    std::uint32_t hash = 2166136261u;
+
+    void add(const std::string_view bytes) {
+        for (const char c : bytes) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+        }
+    }
+};
+
+// the checksum that ends a record covers everything from its head on
+void put_head(std::string& out, const char kind, const std::uint64_t row,
+              const std::uint64_t removed, const std::uint64_t count) {
+    out.push_back(kind);
+    file_io::append_raw(out, row);
+    file_io::append_raw(out, removed);
+    file_io::append_raw(out, count);
+}
+
+void put_line(std::string& out, const std::string_view line) {
+    file_io::append_raw(out, static_cast<std::uint32_t>(line.size()));
+    out.append(line);
+}
+
+class Reader {
+private:
+    std::string_view data;
+    std::size_t pos = 0;
+
+public:
+    explicit Reader(const std::string_view data) : data(data) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (data.size() - pos < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, data.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    bool get_bytes(std::string& out, const std::size_t size) {
+        if (data.size() - pos < size) {
+            return false;
+        }
+        out.assign(data.data() + pos, size);
+        pos += size;
+        return true;
+    }
+
+    std::size_t offset() const {
+        return pos;
+    }
+
+    bool done() const {
+        return pos == data.size();
+    }
+
+    std::string_view since(const std::size_t from) const {
+        return data.substr(from, pos - from);
+    }
+};
+
+struct Record {
+    char kind;
+    std::uint64_t row;
+    std::uint64_t removed;
+    std::vector<std::string> lines;
+};
+
+std::optional<Record> read_record(Reader& in) {
+    const std::size_t start = in.offset();
+    Record record{};
+    std::uint64_t count;
+    if (!in.get(record.kind) || !in.get(record.row) || !in.get(record.removed) ||
+        !in.get(count)) {
+        return std::nullopt;
+    }
+    for (std::uint64_t i = 0; i < count; ++i) {
+        std::uint32_t length;
+        std::string line;
+        if (!in.get(length) || !in.get_bytes(line, length)) {
+            return std::nullopt;
+        }
+        record.lines.push_back(std::move(line));
+    }
+    Fnv fnv;
+    fnv.add(in.since(start));
+    std::uint32_t checksum;
+    if (!in.get(checksum) || checksum != fnv.hash) {
+        return std::nullopt;
+    }
+    return record;
+}
+
+} // namespace
+
+Journal::Journal() : writer(&Journal::work, this) {}
+
+Journal::~Journal() {
+    {
+        std::lock_guard lock(mtx);
+        stopping = true;
+    }
+    cv.notify_one();
+    writer.join();
+}
+
+std::string Journal::path_for(const std::string& filepath) {
+    const fs::path file(filepath);
+    return (file.parent_path() / ("." + file.filename().string() + ".cjournal")).string();
+}
+
+Journal::Base Journal::base_of(const std::string& filepath) {
+    struct stat st {};
+    if (::stat(filepath.c_str(), &st) != 0) {
+        return {}; // a new file, the journal applies to an empty buffer
+    }
+    return {static_cast<std::uint64_t>(st.st_size),
+            static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 +
+                st.st_mtim.tv_nsec};
+}
+
+bool Journal::recoverable(const std::string& filepath) {
+    struct stat journal {};
+    if (::stat(path_for(filepath).c_str(), &journal) != 0 ||
+        static_cast<std::size_t>(journal.st_size) <= header_size) {
+        return false;
+    }
+    struct stat file {};
+    if (::stat(filepath.c_str(), &file) != 0) {
+        return true;
+    }
+    return std::tie(journal.st_mtim.tv_sec, journal.st_mtim.tv_nsec) >=
+           std::tie(file.st_mtim.tv_sec, file.st_mtim.tv_nsec);
+}
+
+std::optional<std::size_t> Journal::recover(const std::string& filepath,
+                                            Buffer& buffer) {
+    std::ifstream file(path_for(filepath), std::ios::binary);
+    const std::string data{std::istreambuf_iterator<char>(file),
+                           std::istreambuf_iterator<char>()};
+    Reader in(data);
+    std::string head;
+    Base recorded;
+    if (!in.get_bytes(head, magic.size()) || head != magic ||
+        !in.get(recorded.size) || !in.get(recorded.mtime_ns)) {
+        return std::nullopt;
+    }
+
+    std::size_t applied = 0;
+    buffer.begin_undo_group({0, 0, 0});
+    for (std::optional<Record> record; !in.done() && (record = read_record(in));) {
+        if (record->kind == checkpoint_record && applied == 0) {
+            buffer.splice_lines(0, buffer.line_count(), std::move(record->lines));
+        } else if (record->kind == edit_record) {
+            if (applied == 0) {
+                // plain edits apply only to the file they were made on
+                const Base current = base_of(filepath);
+                if (current.size != recorded.size ||
+                    current.mtime_ns != recorded.mtime_ns) {
+                    break;
+                }
+            }
+            if (record->row > buffer.line_count() ||
+                record->removed > buffer.line_count() - record->row) {
+                break;
+            }
+            buffer.splice_lines(record->row, record->removed,
+                                std::move(record->lines));
+        } else {
+            break;
+        }
+        ++applied;
+    }
+    buffer.end_undo_group();
+    if (applied == 0) {
+        return std::nullopt;
+    }
+    return applied;
+}
+
+void Journal::start(const std::string& filepath) {
+    const std::string target = path_for(filepath);
+    {
+        std::lock_guard lock(mtx);
+        if (!path.empty() && path != target) {
+            obsolete.push_back(path);
+        }
+        path = target;
+        source = filepath;
+        base = base_of(filepath);
+        rewrite = true;
+        checkpoint.reset();
+        pending.clear();
+    }
+    cv.notify_one();
+    logged = 0;
+    // compacting a big file often would cost more than the replay it saves
+    checkpoint_bytes = std::max<std::size_t>(min_checkpoint_bytes, base.size / 2);
+}
+
+void Journal::rebase() {
+    if (!source.empty()) {
+        start(source);
+    }
+}
+
+void Journal::record(const Buffer& buffer, const BufferChange& change) {
+    if (path.empty()) {
+        return;
+    }
+    std::string out;
+    put_head(out, edit_record, change.row, change.removed, change.inserted);
+    for (std::size_t i = 0; i < change.inserted; ++i) {
+        put_line(out, buffer.line_view(change.row + i));
+    }
+    Fnv fnv;
+    fnv.add(out);
+    file_io::append_raw(out, fnv.hash);
+    logged += out.size();
+
+    bool wake;
+    {
+        std::lock_guard lock(mtx);
+        wake = pending.empty() || pending.size() + out.size() >= flush_bytes;
+        pending += out;
+    }
+    if (wake) {
+        cv.notify_one();
+    }
+}
+
+bool Journal::wants_checkpoint() const {
+    return !path.empty() && logged > checkpoint_bytes;
+}
+
+void Journal::compact(BufferSnapshot text) {
+    if (path.empty()) {
+        return;
+    }
+    {
+        std::lock_guard lock(mtx);
+        // everything pending is part of the snapshot
+        rewrite = true;
+        checkpoint = std::move(text);
+        pending.clear();
+    }
+    cv.notify_one();
+    logged = 0;
+}
+
+void Journal::discard() {
+    {
+        std::lock_guard lock(mtx);
+        if (!path.empty()) {
+            obsolete.push_back(path);
+        }
+        path.clear();
+        source.clear();
+        rewrite = false;
+        checkpoint.reset();
+        pending.clear();
+    }
+    cv.notify_one();
+    logged = 0;
+}
+
+// writes `target` from scratch through a temporary file: header, checkpoint,
+// then the records that followed it; returns the new file opened for
+// appending, -1 on failure
+static int rewrite_file(const std::string& target, const std::string& header,
+                        const std::optional<BufferSnapshot>& text,
+                        const std::string& records) {
+    const std::string tmp = target + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    bool ok = file_io::write_fully(fd, header.data(), header.size());
+    if (ok && text) {
+        std::string out;
+        put_head(out, checkpoint_record, 0, 0, text->line_count());
+        Fnv fnv;
+        for (const auto& chunk : text->chunks()) {
+            for (const auto& line : *chunk) {
+                put_line(out, line);
+                if (out.size() >= (1 << 20)) {
+                    fnv.add(out);
+                    ok = ok && file_io::write_fully(fd, out.data(), out.size());
+                    out.clear();
+                }
+            }
+        }
+        fnv.add(out);
+        file_io::append_raw(out, fnv.hash);
+        ok = ok && file_io::write_fully(fd, out.data(), out.size());
+    }
+    ok = ok && file_io::write_fully(fd, records.data(), records.size()) &&
+         ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok || ::rename(tmp.c_str(), target.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return -1;
+    }
+    file_io::sync_dir(fs::path(target).parent_path().string());
+    return ::open(target.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+}
+
+void Journal::work() {
+    int fd = -1;
+    std::string open_path;
+    while (true) {
+        std::string target;
+        Base at;
+        bool restart;
+        std::optional<BufferSnapshot> text;
+        std::string batch;
+        std::vector<std::string> remove;
+        {
+            std::unique_lock lock(mtx);
+            const auto has_work = [this] {
+                return rewrite || !pending.empty() || !obsolete.empty();
+            };
+            cv.wait(lock, [&] { return stopping || has_work(); });
+            // group commit: let the edits of the next moments join this batch
+            if (!stopping && !rewrite && obsolete.empty()) {
+                cv.wait_for(lock, std::chrono::milliseconds(commit_interval_ms), [this] {
+                    return stopping || rewrite || pending.size() >= flush_bytes;
+                });
+            }
+            if (stopping && !has_work()) {
+                break;
+            }
+            target = path;
+            at = base;
+            restart = std::exchange(rewrite, false);
+            text = std::move(checkpoint);
+            checkpoint.reset();
+            batch.swap(pending);
+            remove.swap(obsolete);
+        }
+
+        for (const auto& old : remove) {
+            if (old == open_path) {
+                ::close(fd);
+                fd = -1;
+                open_path.clear();
+            }
+            ::unlink(old.c_str());
+        }
+        if (restart && !target.empty()) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            std::string header(magic);
+            file_io::append_raw(header, at.size);
+            file_io::append_raw(header, at.mtime_ns);
+            fd = rewrite_file(target, header, text, batch);
+            open_path = fd >= 0 ? target : "";
+        } else if (fd >= 0 && !batch.empty()) {
+            if (file_io::write_fully(fd, batch.data(), batch.size())) {
+                ::fdatasync(fd);
+            }
+        }
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
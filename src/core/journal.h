@@ -0,0 +1,86 @@
+#pragma once
+
+#include "buffer.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ Crash-recovery journal, kept as ".<name>.cjournal" next to the file.
+ Every buffer change is appended as a binary record (the rows it replaced and
+ their new text). The UI thread only encodes records into memory; a writer
+ thread commits them in groups, one write and one fdatasync per batch, at
+ most commit_interval_ms after the first pending change. The records apply
+ to the file as it was on disk when the journal started. Once the log grows
+ past a bound, it is compacted: it is rewritten as a checkpoint of the whole
+ text plus what follows, so a replay never has to go through more than
+ that.
+*/
+
+class Journal {
+private:
+    static constexpr int commit_interval_ms = 200;
+    // a batch this large is committed without waiting for the interval
+    static constexpr std::size_t flush_bytes = 1 << 20;
+    static constexpr std::size_t min_checkpoint_bytes = 16 << 20;
+
+    // identifies the file version the records apply to
+    struct Base {
+        std::uint64_t size = 0;
+        std::int64_t mtime_ns = 0;
+    };
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::string path; // empty while no journal is kept
+    std::string source; // the file being journaled
+    Base base;
+    bool rewrite = false; // start the file over (with `checkpoint` if set)
+    std::optional<BufferSnapshot> checkpoint;
+    std::string pending;
+    std::vector<std::string> obsolete; // journals to delete
+    bool stopping = false;
+    std::thread writer;
+
+    // UI thread only
+    std::size_t logged = 0; // bytes since the journal or checkpoint started
+    std::size_t checkpoint_bytes = min_checkpoint_bytes;
+
+    void work();
+    static Base base_of(const std::string& filepath);
+
+public:
+    Journal();
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    static std::string path_for(const std::string& filepath);
+    // a journal with changes exists for filepath and is newer than the file
+    static bool recoverable(const std::string& filepath);
+    // replays the journal into buffer (loaded from filepath) as one undo
+    // step; the number of changes applied, or nullopt if the journal does
+    // not apply to the file as it is now
+    static std::optional<std::size_t> recover(const std::string& filepath,
+                                              Buffer& buffer);
+
+    // starts an empty journal over filepath as it is on disk, replacing any
+    // journal left behind for it
+    void start(const std::string& filepath);
+    // after a save: the file on disk is the new base, the log starts over
+    void rebase();
+    // called for every buffer change, after it was applied
+    void record(const Buffer& buffer, const BufferChange& change);
+    // the log is past its bound and should be compacted
+    bool wants_checkpoint() const;
+    // replaces everything logged so far with the text of `text`
+    void compact(BufferSnapshot text);
+    // stops journaling and deletes the journal
+    void discard();
+};
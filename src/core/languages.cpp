@@ -0,0 +1,170 @@
+#include "lex.h"
+#include "../utils/perfect_hash.h"
+#include <algorithm>
+#include <string_view>
+
+namespace {
+
+using enum TokenType;
+
+constexpr auto cpp_words = make_perfect_hash<TokenType>({
+    // keywords
+    {"alignas", Keyword},      {"alignof", Keyword},
+    {"asm", Keyword},          {"auto", Keyword},
+    {"break", Keyword},        {"case", Keyword},
+    {"catch", Keyword},        {"class", Keyword},
+    {"concept", Keyword},      {"const", Keyword},
+    {"consteval", Keyword},    {"constexpr", Keyword},
+    {"constinit", Keyword},    {"const_cast", Keyword},
+    {"continue", Keyword},     {"co_await", Keyword},
+    {"co_return", Keyword},    {"co_yield", Keyword},
+    {"decltype", Keyword},     {"default", Keyword},
+    {"delete", Keyword},       {"do", Keyword},
+    {"dynamic_cast", Keyword}, {"else", Keyword},
+    {"enum", Keyword},         {"explicit", Keyword},
+    {"export", Keyword},       {"extern", Keyword},
+    {"for", Keyword},          {"friend", Keyword},
+    {"goto", Keyword},         {"if", Keyword},
+    {"inline", Keyword},       {"mutable", Keyword},
+    {"namespace", Keyword},    {"new", Keyword},
+    {"noexcept", Keyword},     {"operator", Keyword},
+    {"private", Keyword},      {"protected", Keyword},
+    {"public", Keyword},       {"register", Keyword},
+    {"reinterpret_cast", Keyword}, {"requires", Keyword},
+    {"return", Keyword},       {"sizeof", Keyword},
+    {"static", Keyword},       {"static_assert", Keyword},
+    {"static_cast", Keyword},  {"struct", Keyword},
+    {"switch", Keyword},       {"template", Keyword},
+    {"this", Keyword},         {"thread_local", Keyword},
+    {"throw", Keyword},        {"try", Keyword},
+    {"typedef", Keyword},      {"typeid", Keyword},
+    {"typename", Keyword},     {"union", Keyword},
+    {"using", Keyword},        {"virtual", Keyword},
+    {"volatile", Keyword},     {"while", Keyword},
+    // literals
+    {"true", Literal},         {"false", Literal},
+    {"nullptr", Literal},      {"NULL", Literal},
+    // types
+    {"bool", Type},            {"char", Type},
+    {"char8_t", Type},         {"char16_t", Type},
+    {"char32_t", Type},        {"double", Type},
+    {"float", Type},           {"int", Type},
+    {"long", Type},            {"short", Type},
+    {"signed", Type},          {"unsigned", Type},
+    {"void", Type},            {"wchar_t", Type},
+    {"size_t", Type},          {"ptrdiff_t", Type},
+    {"int8_t", Type},          {"int16_t", Type},
+    {"int32_t", Type},         {"int64_t", Type},
+    {"uint8_t", Type},         {"uint16_t", Type},
+    {"uint32_t", Type},        {"uint64_t", Type},
+    {"string", Type},          {"string_view", Type},
+    {"vector", Type},          {"array", Type},
+    {"map", Type},             {"unordered_map", Type},
+    {"set", Type},             {"unordered_set", Type},
+    {"optional", Type},        {"variant", Type},
+    {"pair", Type},            {"unique_ptr", Type},
+    {"shared_ptr", Type},
+});
+
+constexpr auto python_words = make_perfect_hash<TokenType>({
+    {"and", Keyword},      {"as", Keyword},       {"assert", Keyword},
+    {"async", Keyword},    {"await", Keyword},    {"break", Keyword},
+    {"class", Keyword},    {"continue", Keyword}, {"def", Keyword},
+    {"del", Keyword},      {"elif", Keyword},     {"else", Keyword},
+    {"except", Keyword},   {"finally", Keyword},  {"for", Keyword},
+    {"from", Keyword},     {"global", Keyword},   {"if", Keyword},
+    {"import", Keyword},   {"in", Keyword},       {"is", Keyword},
+    {"lambda", Keyword},   {"nonlocal", Keyword}, {"not", Keyword},
+    {"or", Keyword},       {"pass", Keyword},     {"raise", Keyword},
+    {"return", Keyword},   {"try", Keyword},      {"while", Keyword},
+    {"with", Keyword},     {"yield", Keyword},    {"match", Keyword},
+    {"case", Keyword},     {"self", Keyword},
+    {"True", Literal},     {"False", Literal},    {"None", Literal},
+    {"int", Type},         {"str", Type},         {"float", Type},
+    {"bool", Type},        {"bytes", Type},       {"list", Type},
+    {"dict", Type},        {"set", Type},         {"tuple", Type},
+    {"object", Type},      {"type", Type},
+});
+
+constexpr auto json_words = make_perfect_hash<TokenType>({
+    {"true", Literal},
+    {"false", Literal},
+    {"null", Literal},
+});
+
+constexpr auto shell_words = make_perfect_hash<TokenType>({
+    {"if", Keyword},       {"then", Keyword},     {"else", Keyword},
+    {"elif", Keyword},     {"fi", Keyword},       {"for", Keyword},
+    {"while", Keyword},    {"until", Keyword},    {"do", Keyword},
+    {"done", Keyword},     {"case", Keyword},     {"esac", Keyword},
+    {"in", Keyword},       {"select", Keyword},   {"function", Keyword},
+    {"return", Keyword},   {"break", Keyword},    {"continue", Keyword},
+    {"exit", Keyword},     {"local", Keyword},    {"export", Keyword},
+    {"readonly", Keyword}, {"declare", Keyword},  {"unset", Keyword},
+    {"shift", Keyword},    {"source", Keyword},   {"alias", Keyword},
+    {"true", Literal},     {"false", Literal},
+});
+
+constexpr auto makefile_words = make_perfect_hash<TokenType>({
+    {"ifeq", Preprocessor},     {"ifneq", Preprocessor},
+    {"ifdef", Preprocessor},    {"ifndef", Preprocessor},
+    {"else", Preprocessor},     {"endif", Preprocessor},
+    {"include", Keyword},       {"sinclude", Keyword},
+    {"define", Keyword},        {"endef", Keyword},
+    {"export", Keyword},        {"unexport", Keyword},
+    {"override", Keyword},      {"private", Keyword},
+    {"vpath", Keyword},
+});
+
+template <const auto& table>
+std::optional<TokenType> lookup(const std::string_view word) {
+    return table.find(word);
+}
+
+std::optional<TokenType> lookup_none(std::string_view) {
+    return std::nullopt;
+}
+
+constexpr lex::Language text{lex::LanguageId::Text, "text", "", "", "", false,
+                             lookup_none};
+constexpr lex::Language cpp{lex::LanguageId::Cpp, "c++", "//", "/*", "*/",
+                            true, lookup<cpp_words>};
+constexpr lex::Language python{lex::LanguageId::Python, "python", "#", "", "",
+                               false, lookup<python_words>};
+constexpr lex::Language json{lex::LanguageId::Json, "json", "", "", "", false,
+                             lookup<json_words>};
+constexpr lex::Language shell{lex::LanguageId::Shell, "shell", "#", "", "",
+                              false, lookup<shell_words>};
+constexpr lex::Language makefile{lex::LanguageId::Makefile, "make", "#", "",
+                                 "", false, lookup<makefile_words>};
+
+struct Association {
+    std::string_view suffix;
+    const lex::Language& language;
+};
+
+// matched against the end of the path, so full names like "/Makefile" work
+constexpr Association associations[] = {
+    {".cpp", cpp},       {".cc", cpp},        {".cxx", cpp},
+    {".hpp", cpp},       {".hh", cpp},        {".hxx", cpp},
+    {".c", cpp},         {".h", cpp},         {".py", python},
+    {".pyi", python},    {".json", json},     {".sh", shell},
+    {".bash", shell},    {".zsh", shell},     {".mk", makefile},
+    {"/Makefile", makefile}, {"/makefile", makefile},
+    {"/GNUmakefile", makefile},
+};
+
+} // namespace
+
+namespace lex {
+
+const Language& language_for(const std::string_view filepath) {
+    // bare file names have no leading '/', match them as if they did
+    const std::string path = "/" + std::string(filepath);
+    const auto it = std::ranges::find_if(associations, [&](const auto& assoc) {
+        return path.ends_with(assoc.suffix);
+    });
+    return it == std::end(associations) ? text : it->language;
+}
+
+} // namespace lex
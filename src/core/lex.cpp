@@ -1,22 +1,99 @@
 #include "lex.h"
 #include "../utils/log.h"
+#include "../utils/perfect_hash.h"
+#include "../utils/simd_scan.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <iostream>
-#include <regex>
 #include <unordered_map>
-#include <unordered_set>
 
-static const std::unordered_set<std::string> keywords = {
-    "if",     "else",  "for",    "while",    "return",   "auto",  "const",
-    "static", "class", "struct", "template", "typename", "using", "namespace"};
+static constexpr auto operators = make_perfect_hash<bool>({
+    // Single-character
+    {"+", true}, {"-", true}, {"*", true}, {"/", true}, {"%", true},
+    {"=", true}, {"<", true}, {">", true}, {"!", true}, {"&", true},
+    {"|", true}, {"^", true}, {"~", true}, {"?", true}, {":", true},
+    {",", true}, {".", true}, {";", true}, {"(", true}, {")", true},
+    {"{", true}, {"}", true}, {"[", true}, {"]", true},
+
+    // Double-character
+    {"++", true}, {"--", true}, {"->", true}, {"<<", true}, {">>", true},
+    {"==", true}, {"!=", true}, {"<=", true}, {">=", true}, {"+=", true},
+    {"-=", true}, {"*=", true}, {"/=", true}, {"%=", true}, {"&&", true},
+    {"||", true}, {"::", true}, {".*", true}, {"->*", true},
+
+    // Triple-character (C++ specific)
+    {"...", true}, {"<<=", true}, {">>=", true},
+});
+
+static bool is_ident_start(const char c) {
+    return scan::is(c, scan::Ident) && !scan::is(c, scan::Digit);
+}
+
+static bool is_ident_char(const char c) {
+    return scan::is(c, scan::Ident);
+}
+
+// [+-]?(hex|binary|octal|decimal)(.digits)?(exponent)?(suffix)?
+static bool is_number(const std::string_view token) {
+    std::size_t i = 0;
+    if (i < token.size() && (token[i] == '+' || token[i] == '-')) {
+        ++i;
+    }
+    if (i == token.size() || !std::isdigit(static_cast<unsigned char>(token[i]))) {
+        return false;
+    }
+
+    const auto digits = [&](auto pred) {
+        const std::size_t start = i;
+        while (i < token.size() && pred(static_cast<unsigned char>(token[i]))) {
+            ++i;
+        }
+        return i - start;
+    };
+
+    if (token[i] == '0' && i + 1 < token.size() &&
+        (token[i + 1] == 'x' || token[i + 1] == 'X')) {
+        i += 2;
+        if (digits([](const unsigned char c) { return std::isxdigit(c); }) == 0) {
+            return false;
+        }
+    } else if (token[i] == '0' && i + 1 < token.size() &&
+               (token[i + 1] == 'b' || token[i + 1] == 'B')) {
+        i += 2;
+        if (digits([](const unsigned char c) { return c == '0' || c == '1'; }) == 0) {
+            return false;
+        }
+    } else {
+        digits([](const unsigned char c) { return std::isdigit(c); });
+        if (i < token.size() && token[i] == '.') {
+            ++i;
+            digits([](const unsigned char c) { return std::isdigit(c); });
+        }
+        if (i < token.size() && (token[i] == 'e' || token[i] == 'E')) {
+            ++i;
+            if (i < token.size() && (token[i] == '+' || token[i] == '-')) {
+                ++i;
+            }
+            if (digits([](const unsigned char c) { return std::isdigit(c); }) == 0) {
+                return false;
+            }
+        }
+    }
 
-static const std::unordered_set<std::string> types = {
-    "int",    "void",   "float",  "double", "char",          "bool",
-    "size_t", "string", "vector", "map",    "unordered_map", "unique_ptr"};
+    // integer/float suffixes: u, l, ll, f and combinations
+    return digits([](const unsigned char c) {
+               return c == 'u' || c == 'U' || c == 'l' || c == 'L' ||
+                      c == 'f' || c == 'F';
+           }) <= 3 &&
+           i == token.size();
+}
 
 namespace lex {
 
 const uint32_t bg_rgb = 0x282C34;
 const uint32_t selection_bg = 0xADD8E6;
+const uint32_t search_bg = 0x5C4A1E;
 std::unordered_map<TokenType, uint32_t> color_map = {
     {TokenType::Keyword, 0xE06C75},      // red
     {TokenType::Literal, 0x98C379},      // green
@@ -29,144 +106,131 @@ std::unordered_map<TokenType, uint32_t> color_map = {
     {TokenType::Space, 0xABB2BF}         // default
 };
 
-std::vector<std::string> tokenize(const std::string& line) {
-    std::vector<std::string> tokens;
-    std::string current;
-    bool in_string = false, in_char = false, in_comment = false;
-    bool in_preprocessor = false;
-
-    for (size_t i = 0; i < line.size(); ++i) {
-        const char c = line[i];
-
-        if (in_comment) {
-            current += c;
-            // Check for end of line comment (no ending for //)
-            continue;
-        }
-
-        if (in_preprocessor) {
-            current += c;
-            // Preprocessor continues until end of line
-            if (c == '\\') { // Handle line continuation
-                if (i + 1 < line.size() && line[i + 1] == '\n') {
-                    current += '\n';
-                    i++;
-                }
-            } else if (c == '\n' || isspace(c)) {
-                tokens.push_back(current);
-                current.clear();
-                in_preprocessor = false;
-            }
-            continue;
-        }
-
-        if (in_string || in_char) {
-            current += c;
-            // Handle escape sequences
-            if (c == '\\' && i + 1 < line.size()) {
-                current += line[++i];
-                continue;
-            }
-            if ((in_string && c == '"') || (in_char && c == '\'')) {
-                tokens.push_back(current);
-                current.clear();
-                in_string = in_char = false;
-            }
-            continue;
+// end of a quoted literal starting at p (the opening quote), escapes skipped
+static const char* skip_quoted(const char* p, const char* end) {
+    const char quote = *p++;
+    while ((p = scan::find_either(p, end, quote, '\\')) < end) {
+        if (*p == quote) {
+            return p + 1;
         }
+        p = std::min(p + 2, end); // escaped character, if the line goes on
+    }
+    return end;
+}
 
-        if (c == '#') {
-            if (!current.empty()) {
-                tokens.push_back(current);
-                current.clear();
-            }
-            in_preprocessor = true;
-            current += c;
-            continue;
+// end of a numeric literal: identifier characters plus '.' and exponent signs
+static const char* skip_number(const char* p, const char* end) {
+    while (true) {
+        p = scan::skip_ident(p, end);
+        if (p == end) {
+            return p;
         }
-
-        if (c == '/' && i + 1 < line.size() && line[i + 1] == '/') {
-            if (!current.empty()) {
-                tokens.push_back(current);
-                current.clear();
-            }
-            current = "//";
-            in_comment = true;
-            i++; // Skip next slash
-            continue;
+        if (*p == '.' && p + 1 < end && scan::is(p[1], scan::Digit)) {
+            ++p;
+        } else if ((*p == '+' || *p == '-') && (p[-1] == 'e' || p[-1] == 'E')) {
+            ++p;
+        } else {
+            return p;
         }
+    }
+}
 
-        if (c == '"' || c == '\'') {
-            if (!current.empty()) {
-                tokens.push_back(current);
-                current.clear();
-            }
-            current += c;
-            in_string = c == '"';
-            in_char = c == '\'';
-            continue;
+// first occurrence of marker in [p, end), filtered on its first byte
+static const char* find_marker(const char* p, const char* end,
+                               const std::string_view marker) {
+    while ((p = scan::find_either(p, end, marker[0], marker[0])) < end) {
+        if (static_cast<std::size_t>(end - p) >= marker.size() &&
+            std::memcmp(p, marker.data(), marker.size()) == 0) {
+            return p;
         }
+        ++p;
+    }
+    return end;
+}
 
-        if (isspace(c)) {
-            if (!current.empty()) {
-                tokens.push_back(current);
-                current.clear();
-            }
-            current += c;
-            tokens.push_back(current);
-            current.clear();
-            continue;
+std::vector<Token> tokenize(const std::string_view line, const Language& lang,
+                            LineState& state) {
+    std::vector<Token> tokens;
+    const char* const begin = line.data();
+    const char* const end = begin + line.size();
+    const char* p = begin;
+
+    const auto emit = [&](const char* token_end, const TokenType type) {
+        tokens.push_back({std::string_view(p, token_end - p), type});
+        p = token_end;
+    };
+    const auto starts_with = [&](const std::string_view marker) {
+        return !marker.empty() &&
+               static_cast<std::size_t>(end - p) >= marker.size() &&
+               std::memcmp(p, marker.data(), marker.size()) == 0;
+    };
+
+    // a block comment carried over from the previous line
+    if (state == LineState::BlockComment) {
+        const char* close = find_marker(p, end, lang.block_comment_close);
+        if (close == end) {
+            emit(end, TokenType::Comment);
+            return tokens;
         }
+        emit(close + lang.block_comment_close.size(), TokenType::Comment);
+        state = LineState::Normal;
+    }
 
-        if (ispunct(c)) {
-            // Handle multi-character operators
-            if (!current.empty() && ispunct(current[0])) {
-                // Check if combined with previous punctuation forms a known
-                // operator
-                if (std::string combined = current + c; is_operator(
-                        combined)) { // You'll need to implement is_operator
-                    current += c;
-                    continue;
-                }
+    while (p < end) {
+        const char c = *p;
+
+        if (scan::is(c, scan::Space)) {
+            emit(scan::skip_space(p, end), TokenType::Space);
+        } else if (starts_with(lang.line_comment)) {
+            emit(end, TokenType::Comment);
+        } else if (starts_with(lang.block_comment_open)) {
+            const char* close =
+                find_marker(p + lang.block_comment_open.size(), end,
+                            lang.block_comment_close);
+            if (close == end) {
+                state = LineState::BlockComment;
+                emit(end, TokenType::Comment);
+            } else {
+                emit(close + lang.block_comment_close.size(),
+                     TokenType::Comment);
             }
-
-            if (!current.empty()) {
-                tokens.push_back(current);
-                current.clear();
+        } else if (lang.preprocessor && c == '#') {
+            // '#', optional spaces, then the directive name
+            emit(scan::skip_ident(scan::skip_space(p + 1, end), end),
+                 TokenType::Preprocessor);
+        } else if (c == '"' || c == '\'') {
+            emit(skip_quoted(p, end), TokenType::Literal);
+        } else if (scan::is(c, scan::Digit)) {
+            const char* number_end = skip_number(p, end);
+            emit(number_end,
+                 is_number({p, static_cast<std::size_t>(number_end - p)})
+                     ? TokenType::Literal
+                     : TokenType::Identifier);
+        } else if (scan::is(c, scan::Ident)) {
+            const char* word_end = scan::skip_ident(p, end);
+            const auto word = lang.lookup_word(
+                {p, static_cast<std::size_t>(word_end - p)});
+            emit(word_end, word.value_or(TokenType::Identifier));
+        } else if (scan::is(c, scan::High)) {
+            emit(scan::skip_high(p, end), TokenType::Identifier);
+        } else {
+            // longest operator first: 3, 2, then 1 characters
+            std::size_t length = std::min<std::size_t>(3, end - p);
+            while (length > 1 && !is_operator({p, length})) {
+                --length;
             }
-            current += c;
-            tokens.push_back(current);
-            current.clear();
-            continue;
+            emit(p + length, TokenType::Operator);
         }
-
-        current += c;
-    }
-
-    if (!current.empty()) {
-        tokens.push_back(current);
     }
 
     return tokens;
 }
 
-bool is_operator(const std::string& str) {
-    static const std::unordered_set<std::string> operators = {
-        // Single-character
-        "+", "-", "*", "/", "%", "=", "<", ">", "!", "&", "|", "^", "~", "?",
-        ":", ",", ".", ";", "(", ")", "{", "}", "[", "]",
-
-        // Double-character
-        "++", "--", "->", "<<", ">>",
-        "==", "!=", "<=", ">=", "+=", "-=", "*=", "/=", "%=", "&&", "||",
-        "::", ".*", "->*",
-
-        // Triple-character (C++ specific)
-        "...", "<<=", ">>="};
-
+bool is_operator(const std::string_view str) {
     return operators.contains(str);
 }
-TokenType classify_token(const std::string& token) {
+
+TokenType classify_token(const std::string_view token, const Language& lang) {
     if (token.empty())
         return TokenType::Space;
 
@@ -175,7 +239,7 @@ TokenType classify_token(const std::string& token) {
         return TokenType::Space;
 
     // 2. Preprocessor directives
-    if (token[0] == '#')
+    if (lang.preprocessor && token[0] == '#')
         return TokenType::Preprocessor;
 
     // 3. String/character literals
@@ -183,61 +247,104 @@ TokenType classify_token(const std::string& token) {
         return TokenType::Literal;
     }
 
-    // 4. Numeric literals (including hex/octal/binary)
-    static const std::regex number_re{
-        "^[+-]?(?:0[xX][0-9a-fA-F]+|0[bB][01]+|0[0-7]*|[1-9][0-9]*|0)"
-        "(?:\\.[0-9]*)?(?:[eE][+-]?[0-9]+)?(?:u|U|l|L|ll|LL|f|F)?$"};
-    if (std::regex_match(token, number_re)) {
-        return TokenType::Literal;
+    // 4. Comments (the tokenizer keeps the marker at the front)
+    if (!lang.line_comment.empty() && token.starts_with(lang.line_comment)) {
+        return TokenType::Comment;
     }
 
-    // 5. Keywords
-    if (keywords.contains(token))
-        return TokenType::Keyword;
+    // 5. Numeric literals (including hex/octal/binary)
+    if (is_number(token)) {
+        return TokenType::Literal;
+    }
 
-    // 6. Type names
-    if (types.contains(token))
-        return TokenType::Type;
+    // 6. Keywords, types and word literals from the language table
+    if (is_ident_start(token.front())) {
+        if (const auto word = lang.lookup_word(token)) {
+            return *word;
+        }
+    }
 
     // 7. Operators and punctuation
     if (is_operator(token))
         return TokenType::Operator;
 
     // 8. Identifiers (potential functions)
-    static const std::regex identifier_re("^[a-zA-Z_][a-zA-Z0-9_]*$");
-    if (std::regex_match(token, identifier_re)) {
+    if (is_ident_start(token.front()) &&
+        std::all_of(token.begin(), token.end(), is_ident_char)) {
         return TokenType::Identifier;
     }
 
-    // 9. Comments (fallthrough from tokenizer)
-    if (token.find("//") == 0 || token.find("/*") == 0) {
-        return TokenType::Comment;
-    }
-
     // Default to operator for unknown punctuation
     return TokenType::Operator;
 }
 
-void highlight_line(const std::string& line,
-                    const std::function<void(int, TokenType, char)>& callback) {
-    const auto tokens = tokenize(line);
+LineState highlight_line(
+    const std::string_view line, const Language& lang, LineState state,
+    const std::function<void(int, TokenType, char)>& callback) {
+    const auto tokens = tokenize(line, lang, state);
     int x = 0;
 
     for (size_t i = 0; i < tokens.size(); ++i) {
         const auto& token = tokens[i];
-        TokenType type = classify_token(token);
+        TokenType type = token.type;
 
         // Function detection heuristic
         if (type == TokenType::Identifier && i + 1 < tokens.size() &&
-            tokens[i + 1] == "(") {
+            tokens[i + 1].text == "(") {
             type = TokenType::Function;
         }
 
-        for (size_t j = 0; j < token.size(); ++j) {
-            callback(static_cast<int>(x + j), type, token[j]);
+        for (size_t j = 0; j < token.text.size(); ++j) {
+            callback(static_cast<int>(x + j), type, token.text[j]);
         }
-        x += static_cast<int>(token.size());
+        x += static_cast<int>(token.text.size());
     }
+    return state;
+}
+
+LineState scan_state(const std::string_view line, const Language& lang,
+                     LineState state) {
+    if (lang.block_comment_open.empty()) {
+        return state;
+    }
+    tokenize(line, lang, state);
+    return state;
+}
+
+void StateCache::invalidate_from(const std::size_t row) {
+    if (row < end_states.size()) {
+        end_states.resize(row);
+    }
+}
+
+LineState StateCache::state_before(
+    const std::size_t row, const Language& lang,
+    const std::function<std::string(std::size_t)>& line_at) {
+    if (row == 0 || lang.block_comment_open.empty()) {
+        return LineState::Normal;
+    }
+    while (end_states.size() < row) {
+        const LineState prev =
+            end_states.empty() ? LineState::Normal : end_states.back();
+        end_states.push_back(scan_state(line_at(end_states.size()), lang, prev));
+    }
+    return end_states[row - 1];
+}
+
+void StateCache::store(const std::size_t row, const LineState end_state) {
+    if (row < end_states.size()) {
+        end_states[row] = end_state;
+    } else if (row == end_states.size()) {
+        end_states.push_back(end_state);
+    }
+}
+
+void StateCache::seed(std::vector<LineState> states) {
+    end_states = std::move(states);
+}
+
+const std::vector<LineState>& StateCache::states() const {
+    return end_states;
 }
 
 } // namespace lex
@@ -1,6 +1,11 @@
+#pragma once
+
 #include <cstdint>
 #include <functional>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 enum class TokenType {
@@ -16,13 +21,73 @@ enum class TokenType {
 };
 
 namespace lex {
+
+enum class LanguageId {
+    Text,
+    Cpp,
+    Python,
+    Json,
+    Shell,
+    Makefile,
+};
+
+// keyword tables are compiled into perfect hashes, see languages.cpp
+struct Language {
+    LanguageId id;
+    std::string_view name;
+    std::string_view line_comment; // empty if the language has none
+    std::string_view block_comment_open;
+    std::string_view block_comment_close;
+    bool preprocessor;             // '#' starts a directive rather than a comment
+    std::optional<TokenType> (*lookup_word)(std::string_view word);
+};
+
+// lexer state carried from the end of one line into the next
+enum class LineState : std::uint8_t {
+    Normal,
+    BlockComment,
+};
+
+struct Token {
+    std::string_view text; // points into the tokenized line
+    TokenType type;
+};
+
+// picked from the file name/extension, plain text if nothing matches
+const Language& language_for(std::string_view filepath);
+
 extern std::unordered_map<TokenType, uint32_t> color_map;
 extern const uint32_t bg_rgb;
 extern const uint32_t selection_bg;
-std::vector<std::string> tokenize(const std::string& line);
-TokenType classify_token(const std::string& token);
-void highlight_line(const std::string& line,
-                    const std::function<void(int, TokenType, char)>& callback);
-bool is_operator(const std::string& str);
+extern const uint32_t search_bg; // every visible match of the search pattern
+std::vector<Token> tokenize(std::string_view line, const Language& lang,
+                            LineState& state);
+TokenType classify_token(std::string_view token, const Language& lang);
+// returns the state at the end of the line
+LineState highlight_line(std::string_view line, const Language& lang,
+                         LineState state,
+                         const std::function<void(int, TokenType, char)>& callback);
+// same end state as highlight_line, without producing colours
+LineState scan_state(std::string_view line, const Language& lang,
+                     LineState state);
+bool is_operator(std::string_view str);
+
+// end-of-line states for rows [0, size), extended lazily and cut back from
+// the first edited row
+class StateCache {
+private:
+    std::vector<LineState> end_states;
+
+public:
+    void invalidate_from(std::size_t row);
+    // state at the start of row, scanning forward from the last cached row
+    LineState state_before(
+        std::size_t row, const Language& lang,
+        const std::function<std::string(std::size_t)>& line_at);
+    void store(std::size_t row, LineState end_state);
+    // the states of a previous session, for the same text
+    void seed(std::vector<LineState> states);
+    const std::vector<LineState>& states() const;
+};
 
 } // namespace lex
@@ -0,0 +1,251 @@
+#include "line_cache.h"
+#include "../utils/file_io.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr std::string_view magic = "CURSEYL1";
+constexpr std::size_t header_size = 8 + 4 + 4 + 8 + 8 + 8 + 8 + 8 + 8;
+constexpr std::size_t states_offset = header_size - 8; // u64 lexer states
+
+struct Header {
+    FileKey key;
+    std::uint64_t lines = 0;
+    std::uint64_t max_line_length = 0;
+    std::uint64_t states = 0;
+};
+
+bool read_fully(const int fd, void* out, const std::size_t size, const off_t offset) {
+    auto* dst = static_cast<char*>(out);
+    std::size_t done = 0;
+    while (done < size) {
+        const ssize_t n = ::pread(fd, dst + done, size - done,
+                                  offset + static_cast<off_t>(done));
+        if (n <= 0) {
+            return false;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+// the header, if it is an entry for this version of the file
+std::optional<Header> read_header(const int fd, const FileKey& key,
+                                  const std::uint32_t version) {
+    char data[header_size];
+    if (!read_fully(fd, data, header_size, 0) ||
+        std::string_view(data, magic.size()) != magic) {
+        return std::nullopt;
+    }
+    Header header;
+    std::uint32_t stored_version;
+    std::memcpy(&stored_version, data + 8, sizeof(stored_version));
+    std::memcpy(&header.key.size, data + 16, 8);
+    std::memcpy(&header.key.mtime_ns, data + 24, 8);
+    std::memcpy(&header.key.sample, data + 32, 8);
+    std::memcpy(&header.lines, data + 40, 8);
+    std::memcpy(&header.max_line_length, data + 48, 8);
+    std::memcpy(&header.states, data + 56, 8);
+    if (stored_version != version || header.key != key) {
+        return std::nullopt;
+    }
+    return header;
+}
+
+std::string cache_dir() {
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        return (fs::path(xdg) / "cursey").string();
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return (fs::path(home) / ".cache" / "cursey").string();
+    }
+    return {};
+}
+
+} // namespace
+
+std::string LineCache::path_for(const std::string& filepath) {
+    const std::string dir = cache_dir();
+    if (dir.empty()) {
+        return {};
+    }
+    std::error_code ec;
+    const fs::path absolute = fs::absolute(filepath, ec);
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx",
+                  static_cast<unsigned long long>(
+                      file_io::hash_bytes(ec ? filepath : absolute.string())));
+    return (fs::path(dir) / (std::string(name) + ".clines")).string();
+}
+
+std::optional<FileKey> LineCache::key_of(const std::string& filepath) {
+    const int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        static_cast<std::uint64_t>(st.st_size) < min_file_size) {
+        ::close(fd);
+        return std::nullopt;
+    }
+    FileKey key;
+    key.size = static_cast<std::uint64_t>(st.st_size);
+    key.mtime_ns = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 +
+                   st.st_mtim.tv_nsec;
+
+    // evenly spaced blocks, the first at the start and the last at the end
+    std::string block(sample_block_size, '\0');
+    std::uint64_t hash = file_io::hash_seed;
+    const std::uint64_t span = key.size - sample_block_size;
+    for (std::size_t i = 0; i < sample_blocks; ++i) {
+        const auto offset = static_cast<off_t>(span / (sample_blocks - 1) * i);
+        if (!read_fully(fd, block.data(), block.size(), offset)) {
+            ::close(fd);
+            return std::nullopt;
+        }
+        hash = file_io::hash_bytes(block, hash);
+    }
+    ::close(fd);
+    key.sample = hash;
+    return key;
+}
+
+std::optional<LineCache> LineCache::load(const std::string& filepath,
+                                         const FileKey& key) {
+    const std::string path = path_for(filepath);
+    const int fd = path.empty() ? -1 : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    const auto header = read_header(fd, key, format_version);
+    // every line but the last is followed by a '\n'
+    if (!header || header->lines == 0 || header->lines > key.size) {
+        ::close(fd);
+        return std::nullopt;
+    }
+    LineCache index;
+    index.max_line_length = header->max_line_length;
+    index.lengths.resize(header->lines);
+    const bool ok = read_fully(fd, index.lengths.data(),
+                               index.lengths.size() * sizeof(std::uint32_t), header_size);
+    ::close(fd);
+    if (!ok) {
+        return std::nullopt;
+    }
+
+    std::uint64_t text = 0;
+    for (const std::uint32_t length : index.lengths) {
+        text += length;
+    }
+    const std::uint64_t newlines = key.size - std::min(key.size, text);
+    if (newlines != header->lines && newlines != header->lines - 1) {
+        return std::nullopt;
+    }
+    return index;
+}
+
+bool LineCache::store(const std::string& filepath, const FileKey& key,
+                      const LineCache& index) {
+    const std::string path = path_for(filepath);
+    if (path.empty()) {
+        return false;
+    }
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    if (ec) {
+        return false;
+    }
+
+    std::string out(magic);
+    file_io::append_raw(out, format_version);
+    file_io::append_raw(out, std::uint32_t{0});
+    file_io::append_raw(out, key.size);
+    file_io::append_raw(out, key.mtime_ns);
+    file_io::append_raw(out, key.sample);
+    file_io::append_raw<std::uint64_t>(out, index.lengths.size());
+    file_io::append_raw(out, index.max_line_length);
+    file_io::append_raw<std::uint64_t>(out, 0);
+
+    const std::string tmp = path + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    const bool ok =
+        file_io::write_fully(fd, out.data(), out.size()) &&
+        file_io::write_fully(fd, reinterpret_cast<const char*>(index.lengths.data()),
+                             index.lengths.size() * sizeof(std::uint32_t));
+    ::close(fd);
+    // a cache needs no fsync: a torn entry fails its checks and is rebuilt
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::vector<lex::LineState> LineCache::load_states(const std::string& filepath,
+                                                   const FileKey& key) {
+    const std::string path = path_for(filepath);
+    const int fd = path.empty() ? -1 : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return {};
+    }
+    std::vector<lex::LineState> states;
+    const auto header = read_header(fd, key, format_version);
+    if (header && header->states <= header->lines) {
+        states.resize(header->states);
+        const auto offset =
+            static_cast<off_t>(header_size + header->lines * sizeof(std::uint32_t));
+        if (!read_fully(fd, states.data(), states.size(), offset)) {
+            states.clear();
+        }
+        for (const lex::LineState state : states) {
+            if (state > lex::LineState::BlockComment) {
+                states.clear();
+                break;
+            }
+        }
+    }
+    ::close(fd);
+    return states;
+}
+
+bool LineCache::store_states(const std::string& filepath, const FileKey& key,
+                             const std::vector<lex::LineState>& states) {
+    const std::string path = path_for(filepath);
+    const int fd = path.empty() ? -1 : ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const auto header = read_header(fd, key, format_version);
+    if (!header || states.size() > header->lines) {
+        ::close(fd);
+        return false;
+    }
+    // written in place: the count is zeroed first and set last, so an
+    // interrupted update leaves an entry without states rather than a torn one
+    const auto offset =
+        static_cast<off_t>(header_size + header->lines * sizeof(std::uint32_t));
+    const std::uint64_t none = 0;
+    const std::uint64_t count = states.size();
+    const bool ok =
+        ::pwrite(fd, &none, sizeof(none), states_offset) == sizeof(none) &&
+        ::ftruncate(fd, offset) == 0 &&
+        ::pwrite(fd, states.data(), states.size(), offset) ==
+            static_cast<ssize_t>(states.size()) &&
+        ::pwrite(fd, &count, sizeof(count), states_offset) == sizeof(count);
+    ::close(fd);
+    return ok;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "lex.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*
+ Sidecar cache that lets a big file reopen without a rescan, one entry per
+ path under $XDG_CACHE_HOME/cursey (~/.cache/cursey without it).
+   header:  "CURSEYL1", u32 format version, u32 0, u64 file size,
+            i64 mtime (ns), u64 sampled hash, u64 lines, u64 longest line,
+            u64 lexer states
+   body:    u32 length of every line, then one byte per lexer end state
+ An entry applies while size, mtime and the sampled hash all match. The
+ sample covers a few blocks spread over the file: enough to notice a rewrite
+ that kept size and mtime, without reading gigabytes to find out.
+ A missing, stale or damaged entry is ignored and the file is scanned.
+*/
+
+// identifies one version of a file on disk
+struct FileKey {
+    std::uint64_t size = 0;
+    std::int64_t mtime_ns = 0;
+    std::uint64_t sample = 0;
+
+    bool operator==(const FileKey&) const = default;
+};
+
+class LineCache {
+private:
+    static constexpr std::uint32_t format_version = 1;
+    static constexpr std::size_t sample_blocks = 16;
+    static constexpr std::size_t sample_block_size = 4096;
+
+public:
+    // smaller files load faster than their cache entry would
+    static constexpr std::uint64_t min_file_size = 8ull << 20;
+
+    std::vector<std::uint32_t> lengths; // of every line, without the '\n'
+    std::uint64_t max_line_length = 0;
+
+    static std::string path_for(const std::string& filepath);
+    // nullopt for a file that cannot be read or is too small to cache
+    static std::optional<FileKey> key_of(const std::string& filepath);
+
+    // the line index stored for exactly this version of the file
+    static std::optional<LineCache> load(const std::string& filepath,
+                                         const FileKey& key);
+    // replaces the entry for filepath, lexer states are dropped
+    static bool store(const std::string& filepath, const FileKey& key,
+                      const LineCache& index);
+
+    // end-of-line lexer states, empty if there are none for this version
+    static std::vector<lex::LineState> load_states(const std::string& filepath,
+                                                   const FileKey& key);
+    // attaches states to an entry that already holds the line index
+    static bool store_states(const std::string& filepath, const FileKey& key,
+                             const std::vector<lex::LineState>& states);
+};
@@ -0,0 +1,141 @@
+#include "line_diff.h"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <utility>
+
+namespace diff {
+
+namespace {
+
+using Index = std::ptrdiff_t;
+
+// the matched (old, new) rows in order; false past max_edit_distance
+bool myers(const std::vector<std::string_view>& a,
+           const std::vector<std::string_view>& b,
+           std::vector<std::pair<Index, Index>>& matches) {
+    const auto n = static_cast<Index>(a.size());
+    const auto m = static_cast<Index>(b.size());
+    std::vector<std::size_t> ha(a.size());
+    std::vector<std::size_t> hb(b.size());
+    std::transform(a.begin(), a.end(), ha.begin(), std::hash<std::string_view>{});
+    std::transform(b.begin(), b.end(), hb.begin(), std::hash<std::string_view>{});
+    const auto equal = [&](const Index x, const Index y) {
+        return ha[x] == hb[y] && a[x] == b[y];
+    };
+
+    const Index max_d = std::min<Index>(n + m, max_edit_distance);
+    const Index offset = max_d + 1;
+    std::vector<Index> v(static_cast<std::size_t>(2 * offset + 1), 0);
+    // v over [-d, d] as it was before round d, for the walk back
+    std::vector<std::vector<Index>> trace;
+    Index d = 0;
+    for (bool reached = false; !reached; ++d) {
+        if (d > max_d) {
+            return false;
+        }
+        trace.emplace_back(v.begin() + (offset - d), v.begin() + (offset + d + 1));
+        for (Index k = -d; k <= d && !reached; k += 2) {
+            Index x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]))
+                          ? v[offset + k + 1]
+                          : v[offset + k - 1] + 1;
+            Index y = x - k;
+            while (x < n && y < m && equal(x, y)) {
+                ++x;
+                ++y;
+            }
+            v[offset + k] = x;
+            reached = x >= n && y >= m;
+        }
+    }
+
+    Index x = n;
+    Index y = m;
+    for (Index round = d - 1; round > 0; --round) {
+        const auto& prev = trace[static_cast<std::size_t>(round)];
+        const auto at = [&](const Index k) { return prev[k + round]; };
+        const Index k = x - y;
+        const Index prev_k =
+            (k == -round || (k != round && at(k - 1) < at(k + 1))) ? k + 1 : k - 1;
+        const Index prev_x = at(prev_k);
+        const Index prev_y = prev_x - prev_k;
+        // the snake after the edit, then the edit itself
+        while (x > prev_x && y > prev_y) {
+            matches.emplace_back(--x, --y);
+        }
+        x = prev_x;
+        y = prev_y;
+    }
+    while (x > 0 && y > 0) {
+        matches.emplace_back(--x, --y);
+    }
+    std::reverse(matches.begin(), matches.end());
+    return true;
+}
+
+} // namespace
+
+std::vector<Hunk> lines(const std::vector<std::string_view>& old_lines,
+                        const std::vector<std::string_view>& new_lines) {
+    std::size_t head = 0;
+    while (head < old_lines.size() && head < new_lines.size() &&
+           old_lines[head] == new_lines[head]) {
+        ++head;
+    }
+    std::size_t tail = 0;
+    while (tail < old_lines.size() - head && tail < new_lines.size() - head &&
+           old_lines[old_lines.size() - 1 - tail] == new_lines[new_lines.size() - 1 - tail]) {
+        ++tail;
+    }
+    const std::size_t n = old_lines.size() - head - tail;
+    const std::size_t m = new_lines.size() - head - tail;
+    if (n == 0 && m == 0) {
+        return {};
+    }
+
+    std::vector<std::pair<Index, Index>> matches;
+    if (n == 0 || m == 0 ||
+        !myers({old_lines.begin() + static_cast<Index>(head),
+                old_lines.begin() + static_cast<Index>(head + n)},
+               {new_lines.begin() + static_cast<Index>(head),
+                new_lines.begin() + static_cast<Index>(head + m)},
+               matches)) {
+        return {{head, n, head, m}};
+    }
+
+    // every gap between two matched rows is a hunk
+    std::vector<Hunk> hunks;
+    Index px = 0;
+    Index py = 0;
+    matches.emplace_back(static_cast<Index>(n), static_cast<Index>(m));
+    for (const auto& [x, y] : matches) {
+        if (x > px || y > py) {
+            hunks.push_back({head + static_cast<std::size_t>(px),
+                             static_cast<std::size_t>(x - px),
+                             head + static_cast<std::size_t>(py),
+                             static_cast<std::size_t>(y - py)});
+        }
+        px = x + 1;
+        py = y + 1;
+    }
+    return hunks;
+}
+
+std::size_t map_row(const std::size_t row, const std::vector<Hunk>& hunks) {
+    std::size_t old_end = 0; // just past the last hunk before row
+    std::size_t new_end = 0;
+    for (const auto& hunk : hunks) {
+        if (row < hunk.old_row) {
+            break;
+        }
+        if (row < hunk.old_row + hunk.removed) {
+            return hunk.new_row + std::min(row - hunk.old_row,
+                                           hunk.inserted > 0 ? hunk.inserted - 1 : 0);
+        }
+        old_end = hunk.old_row + hunk.removed;
+        new_end = hunk.new_row + hunk.inserted;
+    }
+    return new_end + (row - old_end);
+}
+
+} // namespace diff
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+/*
+ Line diff for taking in a file that changed on disk. The common head and
+ tail are stripped first, which is all most outside edits need; the middle
+ goes through Myers' O(ND) algorithm with lines compared by hash first.
+ Past max_edit_distance the middle is reported as one replaced block: a
+ diff that large would not patch much less than that anyway.
+*/
+
+namespace diff {
+
+inline constexpr std::size_t max_edit_distance = 1000;
+
+// rows [old_row, old_row + removed) of the old text were replaced by rows
+// [new_row, new_row + inserted) of the new one
+struct Hunk {
+    std::size_t old_row;
+    std::size_t removed;
+    std::size_t new_row;
+    std::size_t inserted;
+};
+
+// in row order
+std::vector<Hunk> lines(const std::vector<std::string_view>& old_lines,
+                        const std::vector<std::string_view>& new_lines);
+
+// where an old row ends up; a replaced row maps into its replacement
+std::size_t map_row(std::size_t row, const std::vector<Hunk>& hunks);
+
+} // namespace diff
@@ -0,0 +1,187 @@
+#include "loader.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+
+FileLoader::FileLoader(const int fd, std::string path, std::optional<FileKey> key,
+                       std::function<void()> on_progress)
+    : fd(fd), path(std::move(path)), key(std::move(key)),
+      on_progress(std::move(on_progress)) {
+    worker = std::thread(&FileLoader::work, this);
+}
+
+FileLoader::~FileLoader() {
+    cancelled = true;
+    worker.join();
+    ::close(fd);
+}
+
+std::optional<std::vector<std::string>> FileLoader::read_all(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    FileLoader loader(fd, path, std::nullopt, {});
+    std::vector<std::string> lines;
+    for (bool done = false; !done;) {
+        loader.wait();
+        done = loader.done();
+        auto batch = loader.take();
+        lines.insert(lines.end(), std::make_move_iterator(batch.begin()),
+                     std::make_move_iterator(batch.end()));
+    }
+    return lines;
+}
+
+std::vector<std::string> FileLoader::take() {
+    std::lock_guard lock(mtx);
+    return std::exchange(ready, {});
+}
+
+void FileLoader::wait() {
+    std::unique_lock lock(mtx);
+    cv.wait(lock, [this] { return finished || !ready.empty(); });
+}
+
+bool FileLoader::done() {
+    std::lock_guard lock(mtx);
+    return finished;
+}
+
+std::size_t FileLoader::longest_line() {
+    std::lock_guard lock(mtx);
+    return longest;
+}
+
+std::uint64_t FileLoader::bytes_read() const {
+    return read_bytes;
+}
+
+void FileLoader::work() {
+    std::vector<std::string> batch;
+    std::size_t batch_size = 0;
+    std::size_t max_length = 0;
+    bool first = true;
+    // built while scanning, unless a cached one is being followed
+    LineCache built;
+    bool indexable = key.has_value();
+    bool looked_up = !key.has_value();
+    std::size_t next = 0; // row of the line being read
+
+    const auto flush = [&] {
+        {
+            std::lock_guard lock(mtx);
+            if (ready.empty()) {
+                ready = std::move(batch);
+            } else {
+                ready.insert(ready.end(), std::make_move_iterator(batch.begin()),
+                             std::make_move_iterator(batch.end()));
+            }
+            longest = std::max(longest, max_length);
+        }
+        batch.clear();
+        batch_size = 0;
+        first = false;
+        cv.notify_all();
+        if (on_progress) {
+            on_progress();
+        }
+    };
+    const auto emit = [&](std::string line) {
+        batch_size += line.size() + 1;
+        max_length = std::max(max_length, line.size());
+        if (indexable) {
+            indexable = line.size() <= UINT32_MAX;
+            built.lengths.push_back(static_cast<std::uint32_t>(line.size()));
+        }
+        batch.push_back(std::move(line));
+        ++next;
+        if ((first && batch.size() >= first_batch_lines) || batch_size >= batch_bytes) {
+            flush();
+        }
+    };
+
+    std::string block(block_size, '\0');
+    std::string carry; // the line read so far
+    while (!cancelled) {
+        // the entry is as long as the file has lines, it is read once the
+        // first batch is out and followed from there on
+        if (!looked_up && !first) {
+            looked_up = true;
+            index = LineCache::load(path, *key);
+            indexable = indexable && !index;
+        }
+        const ssize_t n = ::read(fd, block.data(), block.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        read_bytes += static_cast<std::uint64_t>(n);
+        const std::string_view data(block.data(), static_cast<std::size_t>(n));
+        std::size_t pos = 0;
+        while (pos < data.size()) {
+            std::size_t nl = std::string_view::npos;
+            if (index) {
+                const std::size_t length =
+                    next < index->lengths.size() ? index->lengths[next] : SIZE_MAX;
+                const std::size_t end = pos + (length - std::min(length, carry.size()));
+                if (length < carry.size() || length == SIZE_MAX ||
+                    (end < data.size() && data[end] != '\n')) {
+                    // the entry does not fit the file after all: scan from
+                    // here on, starting with what the current line took
+                    index.reset();
+                    std::size_t from = 0;
+                    for (std::size_t cut; (cut = carry.find('\n', from)) != std::string::npos;
+                         from = cut + 1) {
+                        emit(carry.substr(from, cut - from));
+                    }
+                    carry.erase(0, from);
+                    continue;
+                }
+                if (end < data.size()) {
+                    nl = end;
+                }
+            } else if (const void* hit =
+                           std::memchr(data.data() + pos, '\n', data.size() - pos)) {
+                nl = static_cast<std::size_t>(static_cast<const char*>(hit) - data.data());
+            }
+            if (nl == std::string_view::npos) {
+                carry.append(data.substr(pos));
+                break;
+            }
+            carry.append(data.substr(pos, nl - pos));
+            emit(std::move(carry));
+            carry.clear();
+            pos = nl + 1;
+        }
+    }
+    // like std::getline, text after the last '\n' is one more line
+    if (!carry.empty() && !cancelled) {
+        emit(std::move(carry));
+    }
+
+    // before the last batch, the buffer drops the loader once it has that
+    if (indexable && !cancelled && !built.lengths.empty()) {
+        built.max_line_length = max_length;
+        LineCache::store(path, *key, built);
+    }
+
+    {
+        std::lock_guard lock(mtx);
+        ready.insert(ready.end(), std::make_move_iterator(batch.begin()),
+                     std::make_move_iterator(batch.end()));
+        longest = std::max(longest, max_length);
+        finished = true;
+    }
+    cv.notify_all();
+    if (on_progress) {
+        on_progress();
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "line_cache.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ Reads a file into lines on a worker thread, so the first screen can be
+ drawn while the rest is still coming in. Lines are handed over in batches:
+ the first one is cut at first_batch_lines so it is ready almost at once,
+ later ones hold about batch_bytes each.
+ With a line cache entry for the file's key the file is split at the stored
+ lengths, only the byte each one ends at is checked; without one, the index
+ is built on the way and stored once the whole file was read. The entry is
+ as long as the file has lines: the worker reads it after the first batch,
+ so it never holds up the first screen.
+*/
+
+class FileLoader {
+private:
+    static constexpr std::size_t block_size = 1 << 20;
+    static constexpr std::size_t first_batch_lines = 512;
+    static constexpr std::size_t batch_bytes = 4 << 20;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<std::string> ready;
+    std::size_t longest = 0;
+    bool finished = false;
+
+    int fd;
+    std::string path;
+    std::optional<FileKey> key;
+    std::optional<LineCache> index; // loaded by the worker
+    std::atomic<std::uint64_t> read_bytes{0};
+    std::atomic<bool> cancelled{false};
+    std::function<void()> on_progress; // called on the worker thread
+    std::thread worker;
+
+    void work();
+
+public:
+    // takes ownership of fd, opened on `path`; the line cache entry for
+    // `key` is followed if there is one
+    FileLoader(int fd, std::string path, std::optional<FileKey> key,
+               std::function<void()> on_progress);
+    ~FileLoader();
+
+    FileLoader(const FileLoader&) = delete;
+    FileLoader& operator=(const FileLoader&) = delete;
+
+    // the whole file at once, nullopt if it cannot be opened
+    static std::optional<std::vector<std::string>> read_all(const std::string& path);
+
+    // lines read since the last call
+    std::vector<std::string> take();
+    // blocks until there are lines to take or the file is done
+    void wait();
+    // the whole file was read; lines may still be waiting to be taken
+    bool done();
+    // of all lines read so far
+    std::size_t longest_line();
+    std::uint64_t bytes_read() const;
+};
@@ -0,0 +1,352 @@
+#include "mapped_file.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+// the mappings the SIGBUS handler may patch; a slot is free while begin is 0
+struct GuardSlot {
+    std::atomic<std::uintptr_t> begin{0};
+    std::atomic<std::uintptr_t> end{0};
+    std::atomic<bool> faulted{false};
+};
+
+std::array<GuardSlot, 64> guard_slots;
+struct sigaction previous_sigbus {};
+std::uintptr_t page_size = 4096;
+
+void on_sigbus(const int sig, siginfo_t* info, void* context) {
+    const auto addr = reinterpret_cast<std::uintptr_t>(info->si_addr);
+    for (auto& slot : guard_slots) {
+        const std::uintptr_t begin = slot.begin;
+        const std::uintptr_t end = slot.end;
+        if (begin == 0 || addr < begin || addr >= end) {
+            continue;
+        }
+        // the file was cut short under the mapping: zeros from here on, the
+        // read that faulted is retried and the reader goes on
+        const std::uintptr_t page = addr & ~(page_size - 1);
+        if (::mmap(reinterpret_cast<void*>(page), end - page, PROT_READ,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+            slot.faulted = true;
+            return;
+        }
+    }
+    // not one of ours
+    if ((previous_sigbus.sa_flags & SA_SIGINFO) != 0 && previous_sigbus.sa_sigaction) {
+        previous_sigbus.sa_sigaction(sig, info, context);
+    } else if (previous_sigbus.sa_handler != SIG_DFL && previous_sigbus.sa_handler != SIG_IGN) {
+        previous_sigbus.sa_handler(sig);
+    } else {
+        // the fault repeats on return and takes the default action
+        ::signal(SIGBUS, SIG_DFL);
+    }
+}
+
+int guard(const char* data, const std::uint64_t size) {
+    static std::once_flag installed;
+    std::call_once(installed, [] {
+        page_size = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+        struct sigaction action {};
+        action.sa_sigaction = on_sigbus;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        ::sigaction(SIGBUS, &action, &previous_sigbus);
+    });
+    const auto begin = reinterpret_cast<std::uintptr_t>(data);
+    for (std::size_t i = 0; i < guard_slots.size(); ++i) {
+        std::uintptr_t free = 0;
+        if (guard_slots[i].begin != 0) {
+            continue;
+        }
+        guard_slots[i].end = begin + size;
+        guard_slots[i].faulted = false;
+        if (guard_slots[i].begin.compare_exchange_strong(free, begin)) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+} // namespace
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string& path,
+                                             std::optional<FileKey> key,
+                                             std::function<void()> on_progress) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    const auto size = static_cast<std::uint64_t>(st.st_size);
+    void* data = nullptr;
+    // an empty file cannot be mapped, and has nothing to map
+    if (size > 0) {
+        data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (data == MAP_FAILED) {
+        ::close(fd);
+        return nullptr;
+    }
+    return std::make_unique<MappedFile>(fd, static_cast<const char*>(data), size, path,
+                                        std::move(key), std::move(on_progress));
+}
+
+MappedFile::MappedFile(const int fd, const char* data, const std::uint64_t size,
+                       std::string path, std::optional<FileKey> key,
+                       std::function<void()> on_progress)
+    : fd(fd), path(std::move(path)), key(std::move(key)), data(data), size(size),
+      present(size),
+      on_progress(std::move(on_progress)) {
+    if (data) {
+        guard_slot = guard(data, size);
+    }
+    worker = std::thread(&MappedFile::work, this);
+}
+
+MappedFile::~MappedFile() {
+    cancelled = true;
+    worker.join();
+    if (guard_slot >= 0) {
+        guard_slots[guard_slot].begin = 0;
+    }
+    if (data) {
+        ::munmap(const_cast<char*>(data), size);
+    }
+    ::close(fd);
+}
+
+std::size_t MappedFile::take() {
+    std::vector<std::uint64_t> found;
+    {
+        std::lock_guard lock(mtx);
+        found = std::exchange(ready, {});
+    }
+    const std::size_t before = ends.size();
+    if (ends.empty()) {
+        ends = std::move(found);
+    } else {
+        ends.insert(ends.end(), found.begin(), found.end());
+    }
+    clamp_ends();
+    return ends.size() > before ? ends.size() - before : 0;
+}
+
+std::uint64_t MappedFile::shrink_to_file() {
+    std::uint64_t now = present;
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        return now;
+    }
+    // a file that grew again keeps the mapping's size, a shorter one wins
+    const auto on_disk = static_cast<std::uint64_t>(st.st_size);
+    while (on_disk < now && !present.compare_exchange_weak(now, on_disk)) {
+    }
+    return std::min(now, on_disk);
+}
+
+void MappedFile::clamp_ends() {
+    const std::uint64_t limit = present;
+    if (ends.empty() || ends.back() <= limit) {
+        return;
+    }
+    // a row is kept if it starts before the limit; the first one always is
+    const auto first_gone =
+        limit == 0 ? ends.begin() : std::lower_bound(ends.begin(), ends.end(), limit - 1);
+    const auto kept = std::min(ends.size(), static_cast<std::size_t>(first_gone - ends.begin()) + 1);
+    ends.resize(kept);
+    ends.back() = std::min(ends.back(), limit);
+}
+
+bool MappedFile::truncated() {
+    const bool shorter = shrink_to_file() < size ||
+                         (guard_slot >= 0 && guard_slots[guard_slot].faulted);
+    clamp_ends();
+    return shorter;
+}
+
+void MappedFile::wait() {
+    std::unique_lock lock(mtx);
+    cv.wait(lock, [this] { return finished || !ready.empty(); });
+}
+
+bool MappedFile::done() {
+    std::lock_guard lock(mtx);
+    return finished;
+}
+
+std::size_t MappedFile::longest_line() {
+    std::lock_guard lock(mtx);
+    return longest;
+}
+
+std::uint64_t MappedFile::file_size() const {
+    return size;
+}
+
+std::uint64_t MappedFile::bytes_scanned() const {
+    return scanned;
+}
+
+std::size_t MappedFile::line_count() const {
+    return ends.size();
+}
+
+std::string_view MappedFile::line(const std::size_t row) const {
+    const std::uint64_t begin = row > 0 ? ends.at(row - 1) + 1 : 0;
+    return {data + begin, static_cast<std::size_t>(ends.at(row) - begin)};
+}
+
+bool MappedFile::follows(const LineCache& index, const std::size_t rows,
+                         const std::uint64_t offset) const {
+    constexpr std::size_t samples = 64;
+    if (index.lengths.size() < rows) {
+        return false;
+    }
+    std::uint64_t end = 0;
+    for (std::size_t row = 0; row < rows; ++row) {
+        end += index.lengths[row] + 1;
+    }
+    if (end != offset) {
+        return false;
+    }
+    // the key already matched; a few ends read back catch an entry that
+    // was written for another file
+    const std::size_t stride = std::max<std::size_t>(1, (index.lengths.size() - rows) / samples);
+    for (std::size_t row = rows; row < index.lengths.size(); ++row) {
+        end += index.lengths[row];
+        if ((row - rows) % stride == 0 && end < size) {
+            char c = 0;
+            if (::pread(fd, &c, 1, static_cast<off_t>(end)) != 1 || c != '\n') {
+                return false;
+            }
+        }
+        ++end;
+    }
+    return true;
+}
+
+void MappedFile::work() {
+    std::vector<std::uint64_t> batch;
+    std::size_t max_length = 0;
+    bool first = true;
+    std::uint64_t line_start = 0;
+    std::size_t rows = 0;
+    // the entry for the line cache, built on the way unless one is followed
+    LineCache built;
+    bool indexable = key.has_value();
+
+    const auto flush = [&] {
+        {
+            std::lock_guard lock(mtx);
+            if (ready.empty()) {
+                ready = std::move(batch);
+            } else {
+                ready.insert(ready.end(), batch.begin(), batch.end());
+            }
+            longest = std::max(longest, max_length);
+        }
+        batch.clear();
+        first = false;
+        cv.notify_all();
+        if (on_progress) {
+            on_progress();
+        }
+    };
+    const auto emit = [&](const std::uint64_t end) {
+        const std::uint64_t length = end - line_start;
+        max_length = std::max(max_length, static_cast<std::size_t>(length));
+        if (indexable) {
+            indexable = length <= UINT32_MAX;
+            built.lengths.push_back(static_cast<std::uint32_t>(length));
+        }
+        batch.push_back(end);
+        line_start = end + 1;
+        ++rows;
+        if (batch.size() >= (first ? first_batch_lines : batch_lines)) {
+            scanned = std::min(line_start, size);
+            flush();
+        }
+    };
+
+    // the file is read rather than the mapping: past the end of a file
+    // truncated in place a read comes up short where a page raises SIGBUS
+    std::vector<char> block(scan_block);
+    std::uint64_t pos = 0;
+    const auto scan = [&](const bool first_batch) {
+        while (pos < size && !cancelled && !(first_batch && !first)) {
+            const ssize_t got = ::pread(fd, block.data(), std::min(scan_block, size - pos),
+                                        static_cast<off_t>(pos));
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                break;
+            }
+            const char* p = block.data();
+            const char* const end = p + got;
+            while (const void* hit = std::memchr(p, '\n', static_cast<std::size_t>(end - p))) {
+                emit(pos + static_cast<std::uint64_t>(static_cast<const char*>(hit) -
+                                                      block.data()));
+                p = static_cast<const char*>(hit) + 1;
+                if (first_batch && !first) {
+                    break;
+                }
+            }
+            pos = first_batch && !first ? line_start : pos + static_cast<std::uint64_t>(got);
+        }
+    };
+
+    scan(true);
+    std::optional<LineCache> index;
+    if (key && !first && !cancelled) {
+        index = LineCache::load(path, *key);
+    }
+    if (index && follows(*index, rows, line_start)) {
+        indexable = false;
+        built = {};
+        for (std::size_t row = rows; row < index->lengths.size() && !cancelled; ++row) {
+            emit(line_start + index->lengths[row]);
+        }
+        pos = size;
+    } else {
+        scan(false);
+    }
+    // like std::getline, text after the last '\n' is one more line, and an
+    // empty file has one empty row
+    const std::uint64_t limit = std::min(pos, shrink_to_file());
+    if (line_start < limit || line_start == 0) {
+        emit(limit);
+    }
+    scanned = size;
+
+    if (indexable && !cancelled && limit == size && !built.lengths.empty()) {
+        built.max_line_length = max_length;
+        LineCache::store(path, *key, built);
+    }
+
+    {
+        std::lock_guard lock(mtx);
+        ready.insert(ready.end(), batch.begin(), batch.end());
+        longest = std::max(longest, max_length);
+        finished = true;
+    }
+    cv.notify_all();
+    if (on_progress) {
+        on_progress();
+    }
+}
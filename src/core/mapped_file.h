@@ -0,0 +1,113 @@
+#pragma once
+
+#include "line_cache.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/*
+ A file opened for viewing only (-R): the file is mapped and a line is a
+ view into the mapping, so nothing but the index of line ends is held in
+ memory and the text itself stays in the page cache. The index is built by
+ a memchr scan on a worker thread and handed over in batches like the
+ FileLoader's lines, the first one cut short so the first screen is there
+ almost at once. A file big enough for the line cache is only scanned for
+ that first batch when its entry is there: the rest of the ends are summed
+ from the stored lengths, after a sample of them was checked against the
+ file. Without an entry the scan stores one, so a reopen skips it and the
+ editor's lexer states have an entry to go with.
+ Pages that were never written to follow the file on disk: a file that
+ is replaced through a rename keeps its old contents here, but one that is
+ rewritten in place shows up half changed, and one truncated in place
+ (a log rotated with copytruncate) turns the pages past its new end into
+ SIGBUS. Every mapping is registered with a SIGBUS handler that maps zero
+ pages over the rest of it from the faulting page on, so whatever thread
+ was reading a row (a frame, a search, the match index's pool) reads NULs
+ instead of dying. The scan does not touch the mapping at all: it reads the
+ file in blocks of scan_block bytes, which just come up short. The editor
+ calls truncated() before input and frames; it notices either, drops the
+ rows past the new end and reopens the file. Otherwise the editor reopens
+ the file when it sees it change on disk (see DiskWatch).
+*/
+
+class MappedFile {
+private:
+    static constexpr std::size_t first_batch_lines = 512;
+    static constexpr std::size_t batch_lines = 1 << 16;
+    static constexpr std::uint64_t scan_block = 1 << 20;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<std::uint64_t> ready; // line ends found since the last take
+    std::size_t longest = 0;
+    bool finished = false;
+
+    int fd = -1;
+    std::string path;
+    std::optional<FileKey> key; // of the version mapped, if it is cached
+    const char* data = nullptr;
+    std::uint64_t size = 0; // mapped
+    // bytes still in the file, lowered when a check finds it shorter
+    std::atomic<std::uint64_t> present;
+    int guard_slot = -1; // in the SIGBUS handler's table, -1 if it was full
+    // offset of each line's '\n', or the size for an unterminated last line;
+    // only touched by the owning thread
+    std::vector<std::uint64_t> ends;
+    std::atomic<std::uint64_t> scanned{0};
+    std::atomic<bool> cancelled{false};
+    std::function<void()> on_progress; // called on the worker thread
+    std::thread worker;
+
+    void work();
+    // the cached lengths fit the `rows` rows scanned so far, which end
+    // before `offset`, and a sample of the ends after them
+    bool follows(const LineCache& index, std::size_t rows, std::uint64_t offset) const;
+    // checks the file's size again; the bytes that may still be read
+    std::uint64_t shrink_to_file();
+    // drops the rows that start past the bytes still present
+    void clamp_ends();
+
+public:
+    // nullptr if the file cannot be opened or mapped
+    static std::unique_ptr<MappedFile> open(const std::string& path,
+                                            std::optional<FileKey> key,
+                                            std::function<void()> on_progress);
+    // takes over fd, opened on `path`; `key` is the line cache key of the
+    // version mapped, if it has one
+    MappedFile(int fd, const char* data, std::uint64_t size, std::string path,
+               std::optional<FileKey> key, std::function<void()> on_progress);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // adds the line ends found since the last call to the index; the count
+    // of rows added
+    std::size_t take();
+    // blocks until there are line ends to take or the scan is done
+    void wait();
+    // the whole file was scanned; ends may still be waiting to be taken
+    bool done();
+    // of all lines found so far
+    std::size_t longest_line();
+    std::uint64_t file_size() const;
+    std::uint64_t bytes_scanned() const;
+    // the file was cut short in place since it was mapped; the rows past
+    // its new end are gone from the index and it should be opened again
+    bool truncated();
+
+    // rows taken into the index so far; an empty file has one empty row
+    // once the scan is done
+    std::size_t line_count() const;
+    // valid as long as the file stays open
+    std::string_view line(std::size_t row) const;
+};
@@ -0,0 +1,283 @@
+#include "match_index.h"
+#include <algorithm>
+#include <future>
+#include <string>
+#include <tuple>
+
+namespace {
+
+bool before(const SearchMatch& match, const std::size_t row,
+            const std::size_t col) {
+    return std::tie(match.row, match.col) < std::tie(row, col);
+}
+
+bool after(const SearchMatch& match, const std::size_t row,
+           const std::size_t col) {
+    return std::tie(row, col) < std::tie(match.row, match.col);
+}
+
+} // namespace
+
+MatchIndex::MatchIndex(const Buffer& buffer, ThreadPool& pool,
+                       std::function<void()> on_progress)
+    : buffer(buffer), pool(pool), on_progress(std::move(on_progress)) {}
+
+void MatchIndex::set_pattern(const regex::Regex& regex) {
+    pattern = regex;
+    matchers.clear();
+    for (std::size_t t = 0; t < std::max<std::size_t>(pool.size(), 1); ++t) {
+        matchers.push_back(std::make_unique<regex::Matcher>(*pattern));
+    }
+    chunks.clear();
+    for (std::size_t row = 0; row < buffer.line_count(); row += chunk_rows) {
+        chunks.push_back(
+            {row, std::min(chunk_rows, buffer.line_count() - row), false, {}});
+    }
+    stale = true;
+    refresh();
+}
+
+void MatchIndex::clear() {
+    pattern.reset();
+    matchers.clear();
+    chunks.clear();
+    prefix.clear();
+    first_stale = 0;
+    stale = false;
+}
+
+bool MatchIndex::active() const {
+    return pattern.has_value();
+}
+
+bool MatchIndex::complete() const {
+    return !stale;
+}
+
+void MatchIndex::on_change(const BufferChange& change) {
+    if (!pattern) {
+        return;
+    }
+    if (chunks.empty()) {
+        chunks.push_back({0, 0, false, {}});
+    }
+
+    // fold every chunk the edit touched into the first one and mark it stale
+    const std::size_t first = chunk_for(change.row);
+    const std::size_t last =
+        change.removed > 0 ? chunk_for(change.row + change.removed - 1) : first;
+    Chunk& merged = chunks[first];
+    for (std::size_t i = first + 1; i <= last; ++i) {
+        merged.rows += chunks[i].rows;
+    }
+    merged.rows = merged.rows + change.inserted - change.removed;
+    merged.valid = false;
+    merged.matches.clear();
+    chunks.erase(chunks.begin() + first + 1, chunks.begin() + last + 1);
+
+    // chunks below only move
+    for (std::size_t i = first + 1; i < chunks.size(); ++i) {
+        chunks[i].first_row = chunks[i].first_row + change.inserted - change.removed;
+    }
+    // the prefix still holds for the chunks before the edit
+    first_stale = std::min(first_stale, first);
+    stale = true;
+}
+
+void MatchIndex::refresh() {
+    if (!pattern || !stale) {
+        return;
+    }
+
+    // re-cut stale chunks that grew or emptied through edits
+    std::vector<Chunk> recut;
+    recut.reserve(chunks.size());
+    for (auto& chunk : chunks) {
+        if (chunk.valid) {
+            recut.push_back(std::move(chunk));
+            continue;
+        }
+        for (std::size_t offset = 0; offset < chunk.rows; offset += chunk_rows) {
+            recut.push_back({chunk.first_row + offset,
+                             std::min(chunk_rows, chunk.rows - offset), false, {}});
+        }
+    }
+    chunks = std::move(recut);
+
+    std::vector<std::size_t> todo;
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        if (!chunks[i].valid) {
+            todo.push_back(i);
+        }
+    }
+
+    // a chunk per pool thread at a time, until the budget is spent
+    const auto deadline = std::chrono::steady_clock::now() + slice_budget;
+    const std::size_t slice = pool.size();
+    std::size_t next = 0;
+    while (next < todo.size() && std::chrono::steady_clock::now() < deadline) {
+        const std::size_t end = std::min(todo.size(), next + slice);
+        scan_all({todo.begin() + static_cast<std::ptrdiff_t>(next),
+                  todo.begin() + static_cast<std::ptrdiff_t>(end)});
+        next = end;
+    }
+
+    rebuild_prefix();
+    stale = next < todo.size();
+    if (stale && on_progress) {
+        on_progress();
+    }
+}
+
+void MatchIndex::scan_all(const std::vector<std::size_t>& todo) {
+    if (todo.size() == 1) {
+        // a single edited chunk is cheaper to rescan than to hand off
+        scan(chunks[todo.front()], *matchers.front());
+        return;
+    }
+    // each task has its own matcher (and so DFA cache) and strides over the
+    // stale chunks; tasks write disjoint chunks and the buffer is not
+    // mutated until they are all joined
+    const std::size_t tasks = std::min(pool.size(), todo.size());
+    std::vector<std::future<void>> done;
+    done.reserve(tasks);
+    for (std::size_t t = 0; t < tasks; ++t) {
+        done.push_back(pool.submit([this, &todo, t, tasks] {
+            for (std::size_t i = t; i < todo.size(); i += tasks) {
+                scan(chunks[todo[i]], *matchers[t]);
+            }
+        }));
+    }
+    for (auto& task : done) {
+        task.get();
+    }
+}
+
+void MatchIndex::rebuild_prefix() {
+    prefix.assign(1, 0);
+    first_stale = chunks.size();
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        if (!chunks[i].valid && first_stale == chunks.size()) {
+            first_stale = i;
+        }
+        prefix.push_back(prefix.back() + chunks[i].matches.size());
+    }
+}
+
+void MatchIndex::scan(Chunk& chunk, regex::Matcher& matcher) const {
+    std::string scratch;
+    std::vector<regex::Match> found;
+    chunk.matches.clear();
+    for (std::size_t r = 0; r < chunk.rows; ++r) {
+        found.clear();
+        matcher.find_all(buffer.line_view(chunk.first_row + r, scratch), found);
+        for (const auto& match : found) {
+            chunk.matches.push_back({r, match.start, match.length});
+        }
+    }
+    chunk.valid = true;
+}
+
+std::size_t MatchIndex::on_line(const std::size_t row, const std::size_t col) const {
+    const std::size_t length = buffer.get_line_length(row);
+    return length == 0 ? 0 : std::min(col, length - 1);
+}
+
+std::size_t MatchIndex::chunk_for(const std::size_t row) const {
+    const auto it = std::upper_bound(
+        chunks.begin(), chunks.end(), row,
+        [](const std::size_t r, const Chunk& chunk) { return r < chunk.first_row; });
+    return it == chunks.begin() ? 0 : static_cast<std::size_t>(it - chunks.begin()) - 1;
+}
+
+std::size_t MatchIndex::count() {
+    refresh();
+    return prefix.empty() ? 0 : prefix.back();
+}
+
+std::optional<std::size_t> MatchIndex::find_in(const std::size_t c,
+                                               const std::optional<Cursor>& from,
+                                               const bool forward) {
+    if (!chunks[c].valid) {
+        scan(chunks[c], *matchers.front());
+        rebuild_prefix();
+    }
+    const auto& matches = chunks[c].matches;
+    if (matches.empty()) {
+        return std::nullopt;
+    }
+    if (!from) {
+        return forward ? 0 : matches.size() - 1;
+    }
+    const std::size_t rel = from->row - chunks[c].first_row;
+    if (forward) {
+        auto it = std::upper_bound(
+            matches.begin(), matches.end(), rel,
+            [&](const std::size_t r, const SearchMatch& m) {
+                return after(m, r, from->col);
+            });
+        // a match past the end of the cursor's line is where it already is
+        if (it != matches.end() && it->row == rel &&
+            on_line(from->row, it->col) == from->col) {
+            ++it;
+        }
+        if (it == matches.end()) {
+            return std::nullopt;
+        }
+        return static_cast<std::size_t>(it - matches.begin());
+    }
+    const auto it = std::lower_bound(
+        matches.begin(), matches.end(), rel,
+        [&](const SearchMatch& m, const std::size_t r) {
+            return before(m, r, from->col);
+        });
+    if (it == matches.begin()) {
+        return std::nullopt;
+    }
+    return static_cast<std::size_t>(it - matches.begin()) - 1;
+}
+
+std::optional<MatchIndex::Hit> MatchIndex::next(const Cursor& from,
+                                                const bool forward) {
+    refresh();
+    if (!pattern || chunks.empty()) {
+        return std::nullopt;
+    }
+
+    // chunk by chunk from the cursor, wrapping around back into its own
+    const std::size_t n = chunks.size();
+    const std::size_t c0 = chunk_for(from.row);
+    for (std::size_t step = 0; step <= n; ++step) {
+        const std::size_t c = forward ? (c0 + step) % n : (c0 + n - step % n) % n;
+        const auto i = find_in(c, step == 0 ? std::optional(from) : std::nullopt, forward);
+        if (!i) {
+            continue;
+        }
+        SearchMatch match = chunks[c].matches[*i];
+        match.row += chunks[c].first_row;
+        return Hit{match, c < first_stale ? prefix[c] + *i + 1 : 0};
+    }
+    return std::nullopt;
+}
+
+std::optional<std::size_t> MatchIndex::ordinal_at(const Cursor& pos) const {
+    if (chunks.empty() || prefix.empty()) {
+        return std::nullopt;
+    }
+
+    const std::size_t c = chunk_for(pos.row);
+    if (c >= first_stale) {
+        return std::nullopt;
+    }
+    const auto& matches = chunks[c].matches;
+    const std::size_t rel = pos.row - chunks[c].first_row;
+    const auto it = std::lower_bound(
+        matches.begin(), matches.end(), rel,
+        [&](const SearchMatch& m, const std::size_t r) {
+            return before(m, r, pos.col);
+        });
+    if (it == matches.end() || it->row != rel || on_line(pos.row, it->col) != pos.col) {
+        return std::nullopt;
+    }
+    return prefix[c] + static_cast<std::size_t>(it - matches.begin()) + 1;
+}
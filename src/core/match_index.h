@@ -0,0 +1,99 @@
+#pragma once
+
+#include "../utils/regex.h"
+#include "../utils/thread_pool.h"
+#include "buffer.h"
+#include "cursor.h"
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+/*
+ Every match of the last search pattern, kept sorted by position.
+ The buffer is split into chunks of rows that are scanned in parallel on the
+ pool; an edit only marks the chunks it touched as stale, and they are rescanned
+ the next time the index is read. Prefix counts over the chunks make n/N and
+ the "[k/N]" ordinal binary searches.
+ A read scans stale chunks for at most slice_budget and then publishes what
+ it has; on_progress asks for another read while some are left, so a new
+ pattern on a huge file fills in over several frames instead of freezing
+ the UI. The pool only runs while the UI thread waits for the slice, the
+ buffer is never read while it is being edited. n/N scan whatever chunks
+ lie between the cursor and the next match on the spot.
+*/
+
+struct SearchMatch {
+    std::size_t row;
+    std::size_t col;
+    std::size_t length;
+};
+
+class MatchIndex {
+private:
+    static constexpr std::size_t chunk_rows = 4096;
+    static constexpr std::chrono::milliseconds slice_budget{15};
+
+    struct Chunk {
+        std::size_t first_row;
+        std::size_t rows;
+        bool valid = false;
+        // rows relative to first_row, so edits above only move first_row
+        std::vector<SearchMatch> matches;
+    };
+
+    const Buffer& buffer;
+    ThreadPool& pool;
+    std::optional<regex::Regex> pattern;
+    std::vector<Chunk> chunks;
+    std::vector<std::size_t> prefix; // matches before chunk i, size() + 1 entries
+    std::size_t first_stale = 0;     // chunks before it are all scanned
+    bool stale = false;
+    // one per pool task, kept warm across slices until the pattern changes;
+    // the first also scans on the UI thread while the pool is idle
+    std::vector<std::unique_ptr<regex::Matcher>> matchers;
+    std::function<void()> on_progress;       // chunks are left to scan
+
+    void scan(Chunk& chunk, regex::Matcher& matcher) const;
+    // scans chunks[todo[i]] on the pool
+    void scan_all(const std::vector<std::size_t>& todo);
+    void rebuild_prefix();
+    // the first (or last) match of chunk c after (or before) `from`, all of
+    // them without it; the chunk is scanned first if it is stale
+    std::optional<std::size_t> find_in(std::size_t c, const std::optional<Cursor>& from,
+                                       bool forward);
+    std::size_t chunk_for(std::size_t row) const;
+    // the column the cursor takes for a match at col, an empty match past
+    // the end of a line sits on its last character
+    std::size_t on_line(std::size_t row, std::size_t col) const;
+
+public:
+    MatchIndex(const Buffer& buffer, ThreadPool& pool,
+               std::function<void()> on_progress = {});
+
+    // starts over; the chunks are scanned by the next reads
+    void set_pattern(const regex::Regex& regex);
+    void clear();
+    bool active() const;
+
+    // buffer listener
+    void on_change(const BufferChange& change);
+    // rescans stale chunks for up to slice_budget
+    void refresh();
+    // no chunk is stale, count() is final
+    bool complete() const;
+
+    // of the chunks scanned so far
+    std::size_t count();
+    struct Hit {
+        SearchMatch match;
+        std::size_t ordinal; // 1-based, 0 while a chunk before it is stale
+    };
+    // first match strictly after (or before) `from`, wrapping around
+    std::optional<Hit> next(const Cursor& from, bool forward);
+    // 1-based ordinal of the match the cursor at `pos` is on, nullopt while
+    // a chunk before it is still stale
+    std::optional<std::size_t> ordinal_at(const Cursor& pos) const;
+};
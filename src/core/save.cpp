@@ -0,0 +1,163 @@
+#include "save.h"
+#include "../utils/file_io.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+BackgroundSave::BackgroundSave(std::string path, BufferSnapshot text,
+                               std::function<void()> on_progress)
+    : path(std::move(path)), text(std::move(text)),
+      saved_version(this->text.version()),
+      new_file_mode(0666 & ~file_io::current_umask()),
+      on_progress(std::move(on_progress)) {
+    for (const auto& chunk : this->text.chunks()) {
+        for (const auto& line : *chunk) {
+            total += line.size() + 1;
+        }
+    }
+    worker = std::thread(&BackgroundSave::work, this);
+}
+
+BackgroundSave::~BackgroundSave() {
+    worker.join();
+}
+
+bool BackgroundSave::running() const {
+    return !finished;
+}
+
+std::uint64_t BackgroundSave::version() const {
+    return saved_version;
+}
+
+std::size_t BackgroundSave::bytes_written() const {
+    return written;
+}
+
+std::size_t BackgroundSave::bytes_total() const {
+    return total;
+}
+
+bool BackgroundSave::succeeded() const {
+    return ok;
+}
+
+const std::string& BackgroundSave::error() const {
+    return failure;
+}
+
+std::uint64_t BackgroundSave::content_hash() const {
+    return hash;
+}
+
+bool BackgroundSave::write_all(const int fd) {
+    // short lines are packed into one chunk per write, a line longer than a
+    // chunk is written straight from the snapshot
+    std::string chunk;
+    chunk.reserve(chunk_size);
+    hash = file_io::hash_seed;
+    const auto flush = [&] {
+        if (!file_io::write_fully(fd, chunk.data(), chunk.size())) {
+            return false;
+        }
+        hash = file_io::hash_bytes(chunk, hash);
+        written += chunk.size();
+        chunk.clear();
+        if (on_progress) {
+            on_progress();
+        }
+        return true;
+    };
+
+    for (const auto& part : text.chunks()) {
+        for (const auto& line : *part) {
+            if (chunk.size() + line.size() + 1 > chunk_size && !chunk.empty() &&
+                !flush()) {
+                return false;
+            }
+            if (line.size() >= chunk_size) {
+                if (!file_io::write_fully(fd, line.data(), line.size())) {
+                    return false;
+                }
+                hash = file_io::hash_bytes(line, hash);
+                written += line.size();
+            } else {
+                chunk += line;
+            }
+            chunk.push_back('\n');
+        }
+    }
+    return flush();
+}
+
+bool BackgroundSave::write_and_close(const int fd) {
+    if (!write_all(fd)) {
+        failure = std::string("write failed: ") + std::strerror(errno);
+    } else if (::fsync(fd) != 0) {
+        failure = std::string("fsync failed: ") + std::strerror(errno);
+    }
+    if (::close(fd) != 0 && failure.empty()) {
+        failure = std::string("close failed: ") + std::strerror(errno);
+    }
+    return failure.empty();
+}
+
+void BackgroundSave::work() {
+    std::error_code ec;
+    fs::path target = fs::weakly_canonical(path, ec); // through any symlinks
+    if (ec) {
+        target = path;
+    }
+    const fs::path dir = target.has_parent_path() ? target.parent_path() : fs::path(".");
+    struct stat st {};
+    const bool exists = ::stat(target.c_str(), &st) == 0;
+
+    // a hard-linked file is written in place so every name sees the new
+    // text, and so is one in a directory we cannot create files in
+    std::string tmp;
+    int fd = -1;
+    if (!exists || st.st_nlink == 1) {
+        tmp = (dir / ("." + target.filename().string() + ".XXXXXX")).string();
+        fd = ::mkstemp(tmp.data());
+    }
+    if (fd < 0 && exists) {
+        fd = ::open(target.c_str(), O_WRONLY | O_TRUNC | O_CLOEXEC);
+        if (fd < 0) {
+            failure = std::string("cannot open: ") + std::strerror(errno);
+        } else {
+            write_and_close(fd);
+        }
+    } else if (fd < 0) {
+        failure = std::string("cannot create temporary file: ") + std::strerror(errno);
+    } else {
+        // keep the owner and permissions of the file being replaced, as far
+        // as we may: only root can hand a file to another user, but the
+        // group may still be one of ours
+        if (exists && ::fchown(fd, st.st_uid, st.st_gid) != 0) {
+            [[maybe_unused]] const int ignored = ::fchown(fd, static_cast<uid_t>(-1), st.st_gid);
+        }
+        ::fchmod(fd, exists ? st.st_mode & 07777 : new_file_mode);
+        if (write_and_close(fd) && ::rename(tmp.c_str(), target.c_str()) != 0) {
+            failure = std::string("rename failed: ") + std::strerror(errno);
+        }
+        if (!failure.empty()) {
+            ::unlink(tmp.c_str());
+        } else {
+            file_io::sync_dir(dir.string()); // make the rename itself durable
+        }
+    }
+
+    ok = failure.empty();
+    text.release();
+    finished = true;
+    if (on_progress) {
+        on_progress();
+    }
+}
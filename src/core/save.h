@@ -0,0 +1,65 @@
+#pragma once
+
+#include "snapshot.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+
+/*
+ Writes a snapshot of the buffer on a worker thread.
+ The text goes to a temporary file next to the target through large buffered
+ writes, is fsynced and then renamed over the target, so a crash at any point
+ leaves either the old file or the new one. A symlink is resolved first and
+ its target replaced. A file with more than one hard link is rewritten in
+ place instead, since a rename would leave the other names on the old text;
+ that write is not atomic. The UI keeps editing meanwhile and reads the
+ progress counters for the tool line.
+*/
+
+class BackgroundSave {
+private:
+    static constexpr std::size_t chunk_size = 1 << 20;
+
+    std::string path;
+    BufferSnapshot text;
+    std::uint64_t saved_version;
+    mode_t new_file_mode; // for a file that did not exist, read on the UI thread
+    std::size_t total = 0;
+    std::atomic<std::size_t> written{0};
+    std::atomic<bool> finished{false};
+    bool ok = false;
+    std::uint64_t hash = 0; // of the bytes written
+    std::string failure; // set before `finished`
+    std::function<void()> on_progress;
+    std::thread worker;
+
+    void work();
+    bool write_all(int fd);
+    // writes, fsyncs and closes fd; false with `failure` set
+    bool write_and_close(int fd);
+
+public:
+    // on_progress is called from the worker about every chunk and once at
+    // the end
+    BackgroundSave(std::string path, BufferSnapshot text,
+                   std::function<void()> on_progress = {});
+    ~BackgroundSave();
+
+    BackgroundSave(const BackgroundSave&) = delete;
+    BackgroundSave& operator=(const BackgroundSave&) = delete;
+
+    bool running() const;
+    // the buffer version that was snapshotted
+    std::uint64_t version() const;
+    std::size_t bytes_written() const;
+    std::size_t bytes_total() const;
+    // valid once running() is false
+    bool succeeded() const;
+    const std::string& error() const;
+    // file_io::hash_bytes of everything written, valid once running() is false
+    std::uint64_t content_hash() const;
+};
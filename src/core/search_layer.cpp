@@ -0,0 +1,56 @@
+#include "search_layer.h"
+#include <algorithm>
+#include <functional>
+
+void SearchLayer::set_pattern(const regex::Regex& regex) {
+    matcher = std::make_unique<regex::Matcher>(regex);
+    anchors_end = regex.anchors_end();
+    lines.clear();
+}
+
+void SearchLayer::clear() {
+    matcher.reset();
+    lines.clear();
+}
+
+void SearchLayer::update(const Buffer& buffer, const std::size_t first,
+                         const std::size_t last, const std::size_t max_cols) {
+    if (!matcher) {
+        return;
+    }
+
+    const std::size_t end = std::min(last, buffer.line_count());
+    // rows more than a screen out of view are dropped, the cache stays a
+    // few screens big
+    const std::size_t margin = end > first ? end - first : 0;
+    std::erase_if(lines, [&](const auto& entry) {
+        return entry.first + margin < first || entry.first >= end + margin;
+    });
+
+    for (std::size_t row = first; row < end; ++row) {
+        const std::string_view text = buffer.line_view(row);
+        const std::string_view scanned = text.substr(0, std::min(text.size(), max_cols));
+        const bool cut = scanned.size() < text.size();
+        // a line that grows past the cut keeps its prefix but loses its end
+        const std::size_t hash = std::hash<std::string_view>{}(scanned) ^ cut;
+        auto [it, inserted] = lines.try_emplace(row);
+        if (!inserted && it->second.hash == hash) {
+            continue;
+        }
+        it->second.hash = hash;
+        it->second.matches.clear();
+        // the end of a cut line is not the end of the line
+        if (!cut || !anchors_end) {
+            matcher->find_all(scanned, it->second.matches);
+        }
+    }
+}
+
+const std::vector<regex::Match>*
+SearchLayer::matches_for(const std::size_t row) const {
+    const auto it = lines.find(row);
+    if (it == lines.end() || it->second.matches.empty()) {
+        return nullptr;
+    }
+    return &it->second.matches;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../utils/regex.h"
+#include "buffer.h"
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*
+ hlsearch-style highlighting of every visible match of the search pattern.
+ Only the rows on screen are scanned; results are cached per row together
+ with a hash of the line text for a screen above and below the view, so
+ redraws and scrolling back a little reuse them and an edited line is
+ rescanned on its own. Work is bounded by the screen size, never the file
+ size. Lines cut to max_cols are searched in the part that is kept, except
+ by patterns with '$', which would match at the cut.
+*/
+
+class SearchLayer {
+private:
+    struct Line {
+        std::size_t hash;
+        std::vector<regex::Match> matches;
+    };
+
+    std::unique_ptr<regex::Matcher> matcher;
+    bool anchors_end = false;
+    std::unordered_map<std::size_t, Line> lines; // by row
+
+public:
+    void set_pattern(const regex::Regex& regex);
+    void clear();
+
+    // rescans rows in [first, last) whose text changed and forgets those
+    // more than a screen away; only the first max_cols bytes of each line
+    // are searched
+    void update(const Buffer& buffer, std::size_t first, std::size_t last,
+                std::size_t max_cols);
+    // sorted, non-overlapping matches for a row, or nullptr if it has none
+    const std::vector<regex::Match>* matches_for(std::size_t row) const;
+};
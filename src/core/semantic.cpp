@@ -0,0 +1,278 @@
+#include "semantic.h"
+#include <algorithm>
+#include <functional>
+#include <string_view>
+
+#ifdef CURSEY_SEMANTIC_HIGHLIGHT
+#include "clang/Basic/IdentifierTable.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/TokenKinds.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/Token.h"
+#endif
+
+namespace {
+
+std::size_t line_hash(const std::string_view line) {
+    return std::hash<std::string_view>{}(line);
+}
+
+#ifdef CURSEY_SEMANTIC_HIGHLIGHT
+// formerly getStyleForToken in the syntax.cpp prototype
+std::optional<TokenType> style_for(const clang::tok::TokenKind kind,
+                                   const clang::IdentifierInfo* ii,
+                                   const clang::LangOptions& lang_opts) {
+    using namespace clang;
+    switch (kind) {
+    case tok::kw_int: case tok::kw_char: case tok::kw_bool:
+    case tok::kw_float: case tok::kw_double: case tok::kw_void:
+    case tok::kw_short: case tok::kw_long: case tok::kw_signed:
+    case tok::kw_unsigned: case tok::kw_wchar_t: case tok::kw_char16_t:
+    case tok::kw_char32_t: case tok::kw_char8_t:
+        return TokenType::Type;
+
+    case tok::numeric_constant: case tok::string_literal:
+    case tok::char_constant: case tok::wide_char_constant:
+    case tok::utf8_char_constant: case tok::utf16_char_constant:
+    case tok::utf32_char_constant: case tok::wide_string_literal:
+    case tok::utf8_string_literal: case tok::utf16_string_literal:
+    case tok::utf32_string_literal: case tok::kw_true: case tok::kw_false:
+    case tok::kw_nullptr:
+        return TokenType::Literal;
+
+    case tok::comment:
+        return TokenType::Comment;
+
+    case tok::hash: case tok::hashhash:
+        return TokenType::Preprocessor;
+
+    case tok::identifier:
+        return TokenType::Identifier;
+
+    default:
+        if (ii && ii->isKeyword(lang_opts)) {
+            return TokenType::Keyword;
+        }
+        // punctuation is left to the fast lexer
+        return std::nullopt;
+    }
+}
+#endif
+
+} // namespace
+
+const std::vector<SemanticSpan>*
+SemanticResult::spans_for(const std::size_t row,
+                          const std::string_view line) const {
+    if (row >= lines.size() || lines[row].hash != line_hash(line)) {
+        return nullptr;
+    }
+    return &lines[row].spans;
+}
+
+SemanticHighlighter::SemanticHighlighter(const std::string& filepath,
+                                         const bool allowed,
+                                         std::function<void()> on_result)
+    : enabled(allowed && available() && handles(filepath)),
+      on_result(std::move(on_result)) {
+    if (enabled) {
+        worker = std::thread(&SemanticHighlighter::work, this);
+    }
+}
+
+SemanticHighlighter::~SemanticHighlighter() {
+    {
+        std::lock_guard lock(mtx);
+        stopping = true;
+    }
+    cv.notify_one();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool SemanticHighlighter::available() {
+#ifdef CURSEY_SEMANTIC_HIGHLIGHT
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool SemanticHighlighter::handles(const std::string& filepath) {
+    return lex::language_for(filepath).id == lex::LanguageId::Cpp;
+}
+
+void SemanticHighlighter::request(const Buffer& buffer) {
+    // the guard can trip at any batch of a progressive load, so it is
+    // checked here and not only when the highlighter is made
+    if (!enabled || buffer.guard().active || buffer.line_count() > max_lines) {
+        return;
+    }
+
+    std::lock_guard lock(mtx);
+    // only snapshot once the worker has caught up, so typing never queues jobs
+    if (busy || pending || requested_version == buffer.version() + 1) {
+        return;
+    }
+    // + 1 so the initial version 0 still triggers a parse
+    requested_version = buffer.version() + 1;
+
+    pending = Job{buffer.snapshot()};
+    cv.notify_one();
+}
+
+std::shared_ptr<const SemanticResult> SemanticHighlighter::latest() {
+    std::lock_guard lock(mtx);
+    return result;
+}
+
+void SemanticHighlighter::work() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock lock(mtx);
+            cv.wait(lock, [this] { return stopping || pending; });
+            if (stopping) {
+                return;
+            }
+            job = std::move(*pending);
+            pending.reset();
+            busy = true;
+        }
+
+        auto parsed = std::make_shared<const SemanticResult>(parse(job));
+
+        {
+            std::lock_guard lock(mtx);
+            result = std::move(parsed);
+            busy = false;
+        }
+        if (on_result) {
+            on_result();
+        }
+    }
+}
+
+SemanticResult SemanticHighlighter::parse(const Job& job) {
+    SemanticResult parsed;
+    parsed.version = job.text.version();
+    parsed.lines.resize(job.text.line_count());
+    for (std::size_t i = 0; i < job.text.line_count(); ++i) {
+        parsed.lines[i].hash = line_hash(job.text.line(i));
+    }
+
+#ifdef CURSEY_SEMANTIC_HIGHLIGHT
+    std::string source;
+    std::vector<std::size_t> line_starts;
+    for (const auto& chunk : job.text.chunks()) {
+        for (const auto& line : *chunk) {
+            line_starts.push_back(source.size());
+            source += line;
+            source += '\n';
+        }
+    }
+    if (source.empty()) {
+        return parsed;
+    }
+
+    clang::LangOptions lang_opts;
+    lang_opts.CPlusPlus = true;
+    lang_opts.CPlusPlus20 = true;
+    lang_opts.LineComment = true;
+    lang_opts.Bool = true;
+    clang::IdentifierTable identifiers(lang_opts);
+
+    const char* begin = source.data();
+    clang::Lexer lexer(clang::SourceLocation(), lang_opts, begin, begin,
+                       begin + source.size());
+    lexer.SetCommentRetentionState(true);
+
+    struct Lexed {
+        std::size_t offset;
+        std::size_t length;
+        clang::tok::TokenKind kind;
+        std::optional<TokenType> type;
+    };
+    std::vector<Lexed> tokens;
+
+    clang::Token token{};
+    bool last = false;
+    while (!last) {
+        last = lexer.LexFromRawLexer(token);
+        if (token.is(clang::tok::eof)) {
+            break;
+        }
+        const std::size_t length = token.getLength();
+        const std::size_t offset =
+            static_cast<std::size_t>(lexer.getBufferLocation() - begin) -
+            length;
+
+        clang::tok::TokenKind kind = token.getKind();
+        const clang::IdentifierInfo* ii = nullptr;
+        if (kind == clang::tok::raw_identifier) {
+            ii = &identifiers.get(token.getRawIdentifier());
+            kind = ii->getTokenID();
+        }
+        tokens.push_back({offset, length, kind, style_for(kind, ii, lang_opts)});
+    }
+
+    // light parse over the token stream: declarations, calls and directives
+    const auto row_of = [&](const std::size_t offset) {
+        return static_cast<std::size_t>(
+            std::upper_bound(line_starts.begin(), line_starts.end(), offset) -
+            line_starts.begin() - 1);
+    };
+    std::size_t directive_row = SIZE_MAX;
+    for (std::size_t i = 0; i < tokens.size(); ++i) {
+        auto& tok = tokens[i];
+        const std::size_t row = row_of(tok.offset);
+        if (tok.kind == clang::tok::hash &&
+            line_starts[row] + job.text.line(row).find_first_not_of(" \t") ==
+                tok.offset) {
+            directive_row = row;
+        }
+        if (row == directive_row && tok.kind != clang::tok::comment) {
+            tok.type = TokenType::Preprocessor;
+            continue;
+        }
+        if (tok.kind != clang::tok::identifier) {
+            continue;
+        }
+        if (i + 1 < tokens.size() && tokens[i + 1].kind == clang::tok::l_paren) {
+            tok.type = TokenType::Function;
+        } else if (i > 0) {
+            switch (tokens[i - 1].kind) {
+            case clang::tok::kw_class: case clang::tok::kw_struct:
+            case clang::tok::kw_enum: case clang::tok::kw_union:
+            case clang::tok::kw_typename: case clang::tok::kw_namespace:
+                tok.type = TokenType::Type;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // split into per-line spans, block comments may cover several rows
+    for (const auto& tok : tokens) {
+        if (!tok.type) {
+            continue;
+        }
+        std::size_t offset = tok.offset;
+        const std::size_t end = tok.offset + tok.length;
+        while (offset < end) {
+            const std::size_t row = row_of(offset);
+            const std::size_t line_end = line_starts[row] + job.text.line(row).size();
+            const std::size_t span_end = std::min(end, line_end);
+            if (span_end > offset) {
+                parsed.lines[row].spans.push_back(
+                    {offset - line_starts[row], span_end - offset, *tok.type});
+            }
+            offset = line_end + 1;
+        }
+    }
+#endif
+
+    return parsed;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "buffer.h"
+#include "lex.h"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/*
+ Optional clang-backed highlighting for C/C++ files.
+ Parsing runs on a worker thread over a copy of the buffer, results are cached
+ per line (keyed by a hash of the line text) and merged over the lex:: colours
+ by the renderer. Built as a no-op unless CURSEY_SEMANTIC_HIGHLIGHT is defined.
+*/
+
+struct SemanticSpan {
+    std::size_t start;
+    std::size_t length;
+    TokenType type;
+};
+
+struct SemanticLine {
+    std::size_t hash = 0;
+    std::vector<SemanticSpan> spans;
+};
+
+struct SemanticResult {
+    std::uint64_t version = 0;
+    std::vector<SemanticLine> lines;
+
+    // spans for row, or nullptr if the line changed since it was parsed
+    const std::vector<SemanticSpan>* spans_for(std::size_t row,
+                                               std::string_view line) const;
+};
+
+class SemanticHighlighter {
+private:
+    struct Job {
+        BufferSnapshot text;
+    };
+
+    bool enabled;
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::optional<Job> pending;
+    bool busy = false;
+    bool stopping = false;
+    std::uint64_t requested_version = 0;
+    std::shared_ptr<const SemanticResult> result;
+    std::function<void()> on_result; // called on the worker thread
+
+    void work();
+    static SemanticResult parse(const Job& job);
+
+public:
+    // above this many lines a reparse per edit is not worth it
+    static constexpr std::size_t max_lines = 20000;
+
+    // disallowed for files the performance guard has flagged by the time it
+    // is made; request() skips them if the guard trips later. on_result
+    // is called from the worker after each parse is published
+    SemanticHighlighter(const std::string& filepath, bool allowed,
+                        std::function<void()> on_result = {});
+    ~SemanticHighlighter();
+
+    SemanticHighlighter(const SemanticHighlighter&) = delete;
+    SemanticHighlighter& operator=(const SemanticHighlighter&) = delete;
+
+    static bool available();
+    static bool handles(const std::string& filepath);
+
+    // queues a reparse if the buffer changed and the worker is idle
+    void request(const Buffer& buffer);
+    std::shared_ptr<const SemanticResult> latest();
+};
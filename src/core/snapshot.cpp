@@ -0,0 +1,73 @@
+#include "snapshot.h"
+#include "buffer.h"
+#include <algorithm>
+
+BufferSnapshot::BufferSnapshot(std::vector<std::shared_ptr<const Lines>> parts,
+                               const std::uint64_t version)
+    : parts(std::move(parts)), m_version(version) {
+    starts.reserve(this->parts.size());
+    for (const auto& part : this->parts) {
+        starts.push_back(m_line_count);
+        m_line_count += part->size();
+    }
+}
+
+std::uint64_t BufferSnapshot::version() const {
+    return m_version;
+}
+
+std::size_t BufferSnapshot::line_count() const {
+    return m_line_count;
+}
+
+const std::string& BufferSnapshot::line(const std::size_t row) const {
+    const auto it = std::upper_bound(starts.begin(), starts.end(), row);
+    const auto part = static_cast<std::size_t>(it - starts.begin()) - 1;
+    return (*parts[part])[row - starts[part]];
+}
+
+const std::vector<std::shared_ptr<const BufferSnapshot::Lines>>&
+BufferSnapshot::chunks() const {
+    return parts;
+}
+
+void BufferSnapshot::release() {
+    parts.clear();
+    parts.shrink_to_fit();
+    starts.clear();
+    m_line_count = 0;
+}
+
+std::size_t SnapshotCache::chunk_for(const std::size_t row) const {
+    const auto it = std::upper_bound(
+        chunks.begin(), chunks.end(), row,
+        [](const std::size_t r, const Chunk& chunk) { return r < chunk.first_row; });
+    return it == chunks.begin() ? 0 : static_cast<std::size_t>(it - chunks.begin()) - 1;
+}
+
+void SnapshotCache::on_change(const BufferChange& change) {
+    if (chunks.empty()) {
+        return; // nothing built yet
+    }
+
+    // fold the chunks the edit touched into one stale chunk, as MatchIndex does
+    const std::size_t first = chunk_for(change.row);
+    const std::size_t last =
+        change.removed > 0 ? chunk_for(change.row + change.removed - 1) : first;
+    Chunk& merged = chunks[first];
+    for (std::size_t i = first + 1; i <= last; ++i) {
+        merged.rows += chunks[i].rows;
+    }
+    merged.rows = merged.rows + change.inserted - change.removed;
+    merged.lines.reset();
+    chunks.erase(chunks.begin() + static_cast<std::ptrdiff_t>(first + 1),
+                 chunks.begin() + static_cast<std::ptrdiff_t>(last + 1));
+
+    for (std::size_t i = first + 1; i < chunks.size(); ++i) {
+        chunks[i].first_row = chunks[i].first_row + change.inserted - change.removed;
+    }
+}
+
+void SnapshotCache::reset() {
+    chunks.clear();
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ Immutable versions of the buffer text for background readers.
+ The text is mirrored in chunks of lines held by shared_ptr; an edit only
+ marks the chunks it touched stale, and taking a snapshot rebuilds those and
+ shares every other chunk with the previous versions. A snapshot is never
+ written to, so any thread reads it without locks while the UI thread edits
+ the live buffer. A version's chunks are freed when the last snapshot using
+ them is released (or destroyed) and the live mirror has moved on.
+*/
+
+struct BufferChange;
+
+class BufferSnapshot {
+public:
+    using Lines = std::vector<std::string>;
+
+private:
+    std::vector<std::shared_ptr<const Lines>> parts;
+    std::vector<std::size_t> starts; // first row of each part
+    std::uint64_t m_version = 0;
+    std::size_t m_line_count = 0;
+
+public:
+    BufferSnapshot() = default;
+    BufferSnapshot(std::vector<std::shared_ptr<const Lines>> parts,
+                   std::uint64_t version);
+
+    std::uint64_t version() const;
+    std::size_t line_count() const;
+    const std::string& line(std::size_t row) const;
+    // in row order, for sequential readers
+    const std::vector<std::shared_ptr<const Lines>>& chunks() const;
+
+    // drops this snapshot's hold on its version right away
+    void release();
+};
+
+// the chunked mirror a Buffer keeps for snapshots, built on first use
+class SnapshotCache {
+private:
+    struct Chunk {
+        std::size_t first_row;
+        std::size_t rows;
+        std::shared_ptr<const BufferSnapshot::Lines> lines; // null when stale
+    };
+    static constexpr std::size_t chunk_rows = 1024;
+
+    std::vector<Chunk> chunks;
+
+    std::size_t chunk_for(std::size_t row) const;
+
+public:
+    void on_change(const BufferChange& change);
+    // everything stale, e.g. after the whole text was replaced
+    void reset();
+
+    template <typename GetLine>
+    BufferSnapshot take(const std::size_t line_count, const std::uint64_t version,
+                        const GetLine& get_line) {
+        if (chunks.empty()) {
+            chunks.push_back({0, line_count, nullptr});
+        }
+        // stale chunks are re-cut to size and rebuilt, the rest is shared
+        std::vector<Chunk> rebuilt;
+        rebuilt.reserve(chunks.size());
+        std::vector<std::shared_ptr<const BufferSnapshot::Lines>> parts;
+        for (auto& chunk : chunks) {
+            if (chunk.lines) {
+                parts.push_back(chunk.lines);
+                rebuilt.push_back(std::move(chunk));
+                continue;
+            }
+            for (std::size_t offset = 0; offset < chunk.rows; offset += chunk_rows) {
+                const std::size_t rows = std::min(chunk_rows, chunk.rows - offset);
+                BufferSnapshot::Lines lines;
+                lines.reserve(rows);
+                for (std::size_t r = 0; r < rows; ++r) {
+                    lines.push_back(get_line(chunk.first_row + offset + r));
+                }
+                auto shared =
+                    std::make_shared<const BufferSnapshot::Lines>(std::move(lines));
+                parts.push_back(shared);
+                rebuilt.push_back({chunk.first_row + offset, rows, std::move(shared)});
+            }
+        }
+        chunks = std::move(rebuilt);
+        return {std::move(parts), version};
+    }
+};
@@ -2,6 +2,7 @@
 #include "../defs.h"
 #include "lex.h"
 #include <algorithm>
+#include <cctype>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
@@ -130,12 +131,25 @@ void NotcursesTUI::resize(const std::size_t line_count) {
 }
 
 void NotcursesTUI::render_file(const Cursor& cursor, const Buffer& buffer,
+                               const lex::Language& lang,
+                               lex::StateCache& states,
                                const std::size_t view_offset,
                                const std::optional<Cursor>& visual_start,
-                               const std::optional<Cursor>& visual_end) {
+                               const std::optional<Cursor>& visual_end,
+                               const SemanticResult* semantic,
+                               const SearchLayer* search) {
     ncplane_erase(main_plane);
     ncplane_erase(line_plane);
     resize(buffer.line_count());
+    const PerfGuard& guard = buffer.guard();
+    const std::size_t text_cols = max_col - max_line_col;
+    // guarded files skip the state warm-up, every line is lexed on its own
+    lex::LineState state =
+        guard.active
+            ? lex::LineState::Normal
+            : states.state_before(view_offset, lang, [&](const std::size_t row) {
+                  return buffer.get_line(row);
+              });
     for (std::size_t i = 0; i < max_row - 2; ++i) {
         const std::size_t line_index = i + view_offset;
         if (line_index >= buffer.line_count())
@@ -149,8 +163,30 @@ void NotcursesTUI::render_file(const Cursor& cursor, const Buffer& buffer,
             line_num.c_str());
 
         // Text content with syntax highlighting
-        std::string line_text = buffer.get_line(line_index);
-        lex::highlight_line(line_text, [&](const int col, const TokenType type, const char c) {
+        const std::string_view line_text = buffer.line_view(line_index);
+        const std::vector<SemanticSpan>* spans =
+            semantic ? semantic->spans_for(line_index, line_text) : nullptr;
+        std::size_t span_idx = 0;
+        const std::vector<regex::Match>* found =
+            search ? search->matches_for(line_index) : nullptr;
+        std::size_t found_idx = 0;
+        const auto draw_cell = [&](const int col, TokenType type, const char c) {
+            if (static_cast<std::size_t>(col) >= text_cols) {
+                return;
+            }
+
+            // semantic spans are sorted, so walk them alongside the columns
+            if (spans) {
+                const auto ucol = static_cast<std::size_t>(col);
+                while (span_idx < spans->size() &&
+                       (*spans)[span_idx].start + (*spans)[span_idx].length <= ucol) {
+                    ++span_idx;
+                }
+                if (span_idx < spans->size() && (*spans)[span_idx].start <= ucol) {
+                    type = (*spans)[span_idx].type;
+                }
+            }
+
             bool selected = false;
             if (visual_start && visual_end) {
                 Cursor actual_start = *visual_start;
@@ -179,16 +215,44 @@ void NotcursesTUI::render_file(const Cursor& cursor, const Buffer& buffer,
                 }
             }
 
+            // search matches only change the background, under the selection
+            bool highlighted = false;
+            if (found) {
+                const auto ucol = static_cast<std::size_t>(col);
+                while (found_idx < found->size() &&
+                       (*found)[found_idx].start + (*found)[found_idx].length <= ucol) {
+                    ++found_idx;
+                }
+                highlighted = found_idx < found->size() &&
+                              (*found)[found_idx].start <= ucol;
+            }
+
             uint64_t channels = 0;
             ncchannels_set_fg_rgb(&channels, lex::color_map[type]);
-            ncchannels_set_bg_rgb(&channels,
-                                  selected ? lex::selection_bg : lex::bg_rgb);
+            ncchannels_set_bg_rgb(&channels, selected      ? lex::selection_bg
+                                             : highlighted ? lex::search_bg
+                                                           : lex::bg_rgb);
 
             nccell cell = {};
             cell.gcluster = static_cast<unsigned char>(c);
             cell.channels = channels;
             ncplane_putc_yx(main_plane, static_cast<int>(i), col, &cell);
-        });
+        };
+
+        if (guard.active) {
+            // lex only the first columns, draw the rest of the screen plain
+            const std::size_t visible = std::min(line_text.size(), text_cols);
+            const std::string_view lexed =
+                line_text.substr(0, std::min(visible, guard.highlight_cols));
+            lex::highlight_line(lexed, lang, lex::LineState::Normal, draw_cell);
+            for (std::size_t col = lexed.size(); col < visible; ++col) {
+                draw_cell(static_cast<int>(col), TokenType::Identifier,
+                          line_text[col]);
+            }
+        } else {
+            state = lex::highlight_line(line_text, lang, state, draw_cell);
+            states.store(line_index, state);
+        }
     }
 
     // Cursor handling
@@ -200,6 +264,14 @@ void NotcursesTUI::render_file(const Cursor& cursor, const Buffer& buffer,
                      buffer.is_modified());
 }
 
+void NotcursesTUI::set_status(const std::string& text) {
+    status = text;
+}
+
+void NotcursesTUI::set_filename(const std::string_view file) {
+    filename = file;
+}
+
 void NotcursesTUI::render_tool_line(const Cursor& cursor,
                                     const bool& was_modified) const {
     ncplane_erase(tool_plane);
@@ -209,31 +281,91 @@ void NotcursesTUI::render_tool_line(const Cursor& cursor,
     if (was_modified) {
         ncplane_printf_yx(tool_plane, 0, static_cast<int>(filename.size() + 1), "%s", "[+]");
     }
+    if (!status.empty()) {
+        ncplane_printf_yx(tool_plane, 0, static_cast<int>(filename.size() + 5),
+                          "%s", status.c_str());
+    }
     ncplane_printf_yx(tool_plane, 0,
                       static_cast<int>(max_col - pos_str.length()), "%s",
                       pos_str.c_str());
-    notcurses_render(nc);
+    if (!held) {
+        notcurses_render(nc);
+    }
 }
 
 void NotcursesTUI::render_command_line(const std::string& command) const {
     ncplane_erase(cmd_plane);
     ncplane_printf_yx(cmd_plane, 0, 0, ":%s", command.c_str());
-    notcurses_render(nc);
+    if (!held) {
+        notcurses_render(nc);
+    }
 }
 
 void NotcursesTUI::render_message(const std::string& message) const {
+    set_message(message);
+    if (!held) {
+        notcurses_render(nc);
+    }
+}
+
+void NotcursesTUI::set_message(const std::string& message) const {
     ncplane_erase(cmd_plane);
     ncplane_printf_yx(cmd_plane, 0, 0, "%s", message.c_str());
-    notcurses_render(nc);
+}
+
+void NotcursesTUI::hold_render(const bool hold) {
+    held = hold;
 }
 
 TermBoundaries NotcursesTUI::get_terminal_size() const {
     return {max_row, max_col};
 }
 
-int NotcursesTUI::get_char() const {
+// Ctrl-<letter> is reported as its ASCII control code
+static int key_code(const uint32_t id, const ncinput& ni) {
+    if (ncinput_ctrl_p(&ni) && id < 0x80 && std::isalpha(static_cast<int>(id))) {
+        return std::toupper(static_cast<int>(id)) & 0x1f;
+    }
+    return static_cast<int>(id);
+}
+
+int NotcursesTUI::get_char(const int timeout_ms) const {
     ncinput ni;
-    return static_cast<int>(notcurses_get(nc, nullptr, &ni));
+    const timespec timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1'000'000L};
+    const uint32_t id = notcurses_get(nc, timeout_ms < 0 ? nullptr : &timeout, &ni);
+    return key_code(id, ni);
+}
+
+std::string NotcursesTUI::read_paste() const {
+    std::string text;
+    // a terminal that never sends the closing marker ends the paste by going quiet
+    constexpr timespec quiet{0, 50'000'000};
+    while (true) {
+        ncinput ni;
+        const uint32_t id = notcurses_get(nc, &quiet, &ni);
+        if (id == 0 || id == NCKEY_PASTE || id == static_cast<uint32_t>(-1)) {
+            break;
+        }
+        if (id == NCKEY_ENTER || id == '\r') {
+            text.push_back('\n');
+        } else if (ni.utf8[0] != '\0') {
+            text += ni.utf8;
+        } else if (id < 0x80) {
+            text.push_back(static_cast<char>(id));
+        }
+    }
+    return text;
+}
+
+int NotcursesTUI::poll_char() const {
+    ncinput ni;
+    const uint32_t id = notcurses_get_nblock(nc, &ni);
+    // 0 when nothing is queued, -1 on error
+    return id == 0 || id == static_cast<uint32_t>(-1) ? 0 : key_code(id, ni);
+}
+
+int NotcursesTUI::input_fd() const {
+    return notcurses_inputready_fd(nc);
 }
 
 void NotcursesTUI::set_cursor_mode(const CursorMode mode) {
@@ -2,6 +2,9 @@
 
 #include "../defs.h"
 #include "buffer.h"
+#include "lex.h"
+#include "search_layer.h"
+#include "semantic.h"
 #include <cmath>
 #include <notcurses/notcurses.h>
 #include <optional>
@@ -30,7 +33,9 @@ private:
     void create_planes();
     void destroy_planes() const;
     Logger logger = Logger("../logfile.txt");
-    const std::string filename;
+    std::string filename;
+    std::string status; // shown on the tool line after the file name
+    bool held = false;  // drawing still happens, only the flush is skipped
 
 public:
     NotcursesTUI(const Buffer& buffer, std::string_view file);
@@ -42,15 +47,32 @@ public:
     void resize(std::size_t line_count);
 
     void render_file(const Cursor& cursor, const Buffer& buffer,
+                     const lex::Language& lang, lex::StateCache& states,
                      std::size_t view_offset,
                      const std::optional<Cursor>& visual_start,
-                     const std::optional<Cursor>& visual_end);
+                     const std::optional<Cursor>& visual_end,
+                     const SemanticResult* semantic = nullptr,
+                     const SearchLayer* search = nullptr);
     void render_tool_line(const Cursor& cursor, const bool& was_modified) const;
+    void set_status(const std::string& text);
+    void set_filename(std::string_view file);
     void render_command_line(const std::string& command) const;
     void render_message(const std::string& message) const;
+    // draws the message with the next frame instead of rendering now
+    void set_message(const std::string& message) const;
+    // while held, nothing is pushed to the terminal (macro replay)
+    void hold_render(bool hold);
     bool is_selected(const Cursor& pos, const Cursor& start, const Cursor& end);
 
     TermBoundaries get_terminal_size() const;
-    int get_char() const;
+    // blocks when timeout_ms is negative, 0 if it expires first
+    int get_char(int timeout_ms = -1) const;
+    // next already queued key, 0 if there is none
+    int poll_char() const;
+    // readable when input is waiting, for the event loop
+    int input_fd() const;
+    // after get_char() returned NCKEY_PASTE: the pasted text up to the
+    // closing marker, with line breaks as '\n'
+    std::string read_paste() const;
     static void set_cursor_mode(CursorMode mode);
 };
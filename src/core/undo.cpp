@@ -0,0 +1,107 @@
+#include "undo.h"
+#include "undo_file.h"
+#include <iterator>
+#include <utility>
+
+void UndoHistory::begin_group(const Cursor& cursor) {
+    if (depth++ == 0) {
+        open = UndoRecord{cursor, {}};
+    }
+}
+
+void UndoHistory::end_group() {
+    if (depth == 0 || --depth > 0) {
+        return;
+    }
+    if (!open->edits.empty()) {
+        done.push_back(std::move(*open));
+    }
+    open.reset();
+}
+
+void UndoHistory::record(LineEdit edit) {
+    undone.clear();
+    if (!open) {
+        done.push_back({{edit.row, 0, 0}, {}});
+        done.back().edits.push_back(std::move(edit));
+        return;
+    }
+
+    // typing on one line records an edit per key, keep only the net change
+    if (!open->edits.empty()) {
+        LineEdit& last = open->edits.back();
+        if (edit.row >= last.row &&
+            edit.row + edit.before.size() <= last.row + last.after.size()) {
+            const auto first = last.after.begin() +
+                               static_cast<std::ptrdiff_t>(edit.row - last.row);
+            const auto pos = last.after.erase(
+                first, first + static_cast<std::ptrdiff_t>(edit.before.size()));
+            last.after.insert(pos, std::make_move_iterator(edit.after.begin()),
+                              std::make_move_iterator(edit.after.end()));
+            return;
+        }
+    }
+    open->edits.push_back(std::move(edit));
+}
+
+std::optional<UndoRecord> UndoHistory::pop_undo() {
+    if (done.empty()) {
+        if (stored_left == 0) {
+            return std::nullopt;
+        }
+        // decoded only now, the stored history costs nothing until reached
+        auto record = stored->decode(--stored_left);
+        if (!record) {
+            stored_left = 0; // damaged, nothing older is reachable
+        }
+        return record;
+    }
+    UndoRecord record = std::move(done.back());
+    done.pop_back();
+    return record;
+}
+
+std::optional<UndoRecord> UndoHistory::pop_redo() {
+    if (undone.empty()) {
+        return std::nullopt;
+    }
+    UndoRecord record = std::move(undone.back());
+    undone.pop_back();
+    return record;
+}
+
+void UndoHistory::push_undo(UndoRecord record) {
+    done.push_back(std::move(record));
+}
+
+void UndoHistory::push_redo(UndoRecord record) {
+    undone.push_back(std::move(record));
+}
+
+void UndoHistory::attach(std::shared_ptr<const UndoFile> file) {
+    stored_left = file ? file->size() : 0;
+    stored = std::move(file);
+}
+
+bool UndoHistory::persist(const std::string& path, const std::uint64_t content_hash) {
+    // the stored records stay where they are, only the new ones are encoded
+    const bool in_place = stored && stored->maps(path);
+    if (in_place ? !UndoFile::append(path, content_hash, *stored, stored_left, done)
+                 : !UndoFile::write(path, content_hash, stored.get(), stored_left, done)) {
+        if (in_place) {
+            attach(nullptr); // its tail may have been overwritten already
+        }
+        return false;
+    }
+    // the records written are dropped from memory and read back lazily
+    auto file = UndoFile::open(path);
+    if (!file) {
+        if (in_place) {
+            attach(nullptr);
+        }
+        return false;
+    }
+    attach(std::move(file));
+    done.clear();
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "../defs.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// rows [row, row + before.size()) held `before` and now hold `after`
+struct LineEdit {
+    std::size_t row;
+    std::vector<std::string> before;
+    std::vector<std::string> after;
+};
+
+// everything one command changed, undone and redone as a unit
+struct UndoRecord {
+    Cursor cursor; // where the command started
+    std::vector<LineEdit> edits;
+};
+
+class UndoFile;
+
+class UndoHistory {
+private:
+    // history from an earlier session, older than everything in `done`;
+    // its first `stored_left` records are still reachable by undo
+    std::shared_ptr<const UndoFile> stored;
+    std::size_t stored_left = 0;
+    std::vector<UndoRecord> done;
+    std::vector<UndoRecord> undone;
+    std::optional<UndoRecord> open;
+    std::size_t depth = 0;
+
+public:
+    // groups nest, edits are collected until the outermost one ends
+    void begin_group(const Cursor& cursor);
+    void end_group();
+
+    // adds to the open group (or a group of its own) and drops the redo list;
+    // an edit inside the rows the previous one produced is folded into it
+    void record(LineEdit edit);
+
+    std::optional<UndoRecord> pop_undo();
+    std::optional<UndoRecord> pop_redo();
+    void push_undo(UndoRecord record);
+    void push_redo(UndoRecord record);
+
+    // takes `file` as the history before everything recorded so far
+    void attach(std::shared_ptr<const UndoFile> file);
+    // writes all undoable history to `path`; it then becomes the stored part
+    bool persist(const std::string& path, std::uint64_t content_hash);
+};
@@ -0,0 +1,271 @@
+#include "undo_file.h"
+#include "../utils/file_io.h"
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr std::string_view magic = "CURSEYU1";
+constexpr std::size_t header_size = 8 + 4 + 4 + 8 + 8 + 8;
+constexpr std::size_t version_offset = 8;
+constexpr std::size_t index_offset_field = 32;
+
+std::string header(const std::uint32_t version, const std::uint64_t content_hash,
+                   const std::uint64_t count, const std::uint64_t index_offset) {
+    std::string out(magic);
+    file_io::append_raw(out, version);
+    file_io::append_raw(out, std::uint32_t{0});
+    file_io::append_raw(out, content_hash);
+    file_io::append_raw(out, count);
+    file_io::append_raw(out, index_offset);
+    return out;
+}
+
+bool write_at(const int fd, const std::string_view data, const std::uint64_t offset) {
+    return ::lseek(fd, static_cast<off_t>(offset), SEEK_SET) >= 0 &&
+           file_io::write_fully(fd, data.data(), data.size());
+}
+
+// pads `out`, which will sit at `base` in the file, so that the index lands
+// aligned, then appends the index; returns where it starts
+std::uint64_t append_index(std::string& out, const std::uint64_t base,
+                           const std::vector<std::uint64_t>& offsets) {
+    out.resize((base + out.size() + 7) / 8 * 8 - base); // the index is read in place
+    const std::uint64_t index_offset = base + out.size();
+    for (const std::uint64_t offset : offsets) {
+        file_io::append_raw(out, offset);
+    }
+    return index_offset;
+}
+
+void encode(std::string& out, const UndoRecord& record) {
+    file_io::append_raw<std::uint64_t>(out, record.cursor.row);
+    file_io::append_raw<std::uint64_t>(out, record.cursor.col);
+    file_io::append_raw<std::uint64_t>(out, record.edits.size());
+    const auto put_lines = [&](const std::vector<std::string>& lines) {
+        for (const auto& line : lines) {
+            file_io::append_raw(out, static_cast<std::uint32_t>(line.size()));
+            out += line;
+        }
+    };
+    for (const auto& edit : record.edits) {
+        file_io::append_raw<std::uint64_t>(out, edit.row);
+        file_io::append_raw<std::uint64_t>(out, edit.before.size());
+        file_io::append_raw<std::uint64_t>(out, edit.after.size());
+        put_lines(edit.before);
+        put_lines(edit.after);
+    }
+}
+
+// bounds-checked reads over one record
+class RecordReader {
+private:
+    std::string_view data;
+    std::size_t pos = 0;
+
+public:
+    explicit RecordReader(const std::string_view data) : data(data) {}
+
+    bool get(std::uint64_t& value) {
+        if (data.size() - pos < sizeof(value)) {
+            return false;
+        }
+        std::memcpy(&value, data.data() + pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    }
+
+    bool get_lines(const std::uint64_t count, std::vector<std::string>& out) {
+        for (std::uint64_t i = 0; i < count; ++i) {
+            std::uint32_t length;
+            if (data.size() - pos < sizeof(length)) {
+                return false;
+            }
+            std::memcpy(&length, data.data() + pos, sizeof(length));
+            pos += sizeof(length);
+            if (data.size() - pos < length) {
+                return false;
+            }
+            out.emplace_back(data.substr(pos, length));
+            pos += length;
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+UndoFile::~UndoFile() {
+    if (map != nullptr) {
+        ::munmap(map, map_size);
+    }
+}
+
+std::string UndoFile::path_for(const std::string& filepath) {
+    const fs::path file(filepath);
+    return (file.parent_path() / ("." + file.filename().string() + ".cundo")).string();
+}
+
+std::unique_ptr<UndoFile> UndoFile::open(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < header_size) {
+        ::close(fd);
+        return nullptr;
+    }
+    const auto size = static_cast<std::size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return nullptr;
+    }
+    std::unique_ptr<UndoFile> file(new UndoFile());
+    file->map = map;
+    file->map_size = size;
+    file->device = static_cast<std::uint64_t>(st.st_dev);
+    file->inode = static_cast<std::uint64_t>(st.st_ino);
+    ::madvise(map, size, MADV_RANDOM);
+
+    const char* data = static_cast<const char*>(map);
+    std::uint32_t version;
+    std::uint64_t hash, count, index_offset;
+    std::memcpy(&version, data + 8, sizeof(version));
+    std::memcpy(&hash, data + 16, sizeof(hash));
+    std::memcpy(&count, data + 24, sizeof(count));
+    std::memcpy(&index_offset, data + 32, sizeof(index_offset));
+    if (std::string_view(data, magic.size()) != magic || version != format_version ||
+        index_offset < header_size || index_offset > size ||
+        (size - index_offset) / sizeof(std::uint64_t) <= count ||
+        index_offset % alignof(std::uint64_t) != 0) {
+        return nullptr;
+    }
+    file->count = count;
+    file->hash = hash;
+    file->index = reinterpret_cast<const std::uint64_t*>(data + index_offset);
+    return file;
+}
+
+bool UndoFile::write(const std::string& path, const std::uint64_t content_hash,
+                     const UndoFile* older, const std::size_t keep,
+                     const std::vector<UndoRecord>& newer) {
+    std::string out = header(format_version, content_hash, keep + newer.size(),
+                             0); // index offset, patched below
+
+    std::vector<std::uint64_t> offsets;
+    offsets.reserve(keep + newer.size());
+    for (std::size_t i = 0; i < keep; ++i) {
+        offsets.push_back(out.size());
+        out += older->raw(i);
+    }
+    for (const auto& record : newer) {
+        offsets.push_back(out.size());
+        encode(out, record);
+    }
+    offsets.push_back(out.size()); // end of the last record
+    const std::uint64_t index_offset = append_index(out, 0, offsets);
+    std::memcpy(out.data() + index_offset_field, &index_offset, sizeof(index_offset));
+
+    const std::string tmp = path + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    const bool ok = file_io::write_fully(fd, out.data(), out.size());
+    ::close(fd);
+    // renaming keeps any mapping of the previous file valid
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool UndoFile::append(const std::string& path, const std::uint64_t content_hash,
+                      const UndoFile& older, const std::size_t keep,
+                      const std::vector<UndoRecord>& newer) {
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    // where the kept records end; everything after it is rewritten
+    const std::uint64_t base = older.index[keep];
+    std::vector<std::uint64_t> offsets(older.index, older.index + keep);
+    std::string out;
+    for (const auto& record : newer) {
+        offsets.push_back(base + out.size());
+        encode(out, record);
+    }
+    offsets.push_back(base + out.size());
+    const std::uint64_t index_offset = append_index(out, base, offsets);
+
+    struct stat st {};
+    const std::uint32_t invalid_version = 0;
+    const bool ok =
+        ::fstat(fd, &st) == 0 && static_cast<std::uint64_t>(st.st_ino) == older.inode &&
+        static_cast<std::uint64_t>(st.st_dev) == older.device &&
+        base >= header_size && base <= static_cast<std::uint64_t>(st.st_size) &&
+        write_at(fd, {reinterpret_cast<const char*>(&invalid_version), sizeof(invalid_version)},
+                 version_offset) &&
+        write_at(fd, out, base) &&
+        ::ftruncate(fd, static_cast<off_t>(base + out.size())) == 0 &&
+        write_at(fd, header(format_version, content_hash, keep + newer.size(), index_offset),
+                 0);
+    ::close(fd);
+    return ok;
+}
+
+bool UndoFile::maps(const std::string& path) const {
+    struct stat st {};
+    return ::stat(path.c_str(), &st) == 0 &&
+           static_cast<std::uint64_t>(st.st_dev) == device &&
+           static_cast<std::uint64_t>(st.st_ino) == inode;
+}
+
+std::uint64_t UndoFile::content_hash() const {
+    return hash;
+}
+
+std::size_t UndoFile::size() const {
+    return count;
+}
+
+std::string_view UndoFile::raw(const std::size_t i) const {
+    const char* data = static_cast<const char*>(map);
+    const auto index_offset =
+        static_cast<std::size_t>(reinterpret_cast<const char*>(index) - data);
+    if (index[i] < header_size || index[i] > index[i + 1] ||
+        index[i + 1] > index_offset) {
+        return {};
+    }
+    return {data + index[i], index[i + 1] - index[i]};
+}
+
+std::optional<UndoRecord> UndoFile::decode(const std::size_t i) const {
+    RecordReader in(raw(i));
+    UndoRecord record;
+    std::uint64_t row, col, edits;
+    if (!in.get(row) || !in.get(col) || !in.get(edits)) {
+        return std::nullopt;
+    }
+    record.cursor = {row, col, col};
+    for (std::uint64_t e = 0; e < edits; ++e) {
+        LineEdit edit;
+        std::uint64_t edit_row, before, after;
+        if (!in.get(edit_row) || !in.get(before) || !in.get(after) ||
+            !in.get_lines(before, edit.before) || !in.get_lines(after, edit.after)) {
+            return std::nullopt;
+        }
+        edit.row = edit_row;
+        record.edits.push_back(std::move(edit));
+    }
+    return record;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "undo.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ Undo history saved next to the file as ".<name>.cundo", valid only for the
+ text whose content hash it carries.
+   header:  "CURSEYU1", u32 format version, u32 0, u64 content hash,
+            u64 record count, u64 index offset
+   records: u64 cursor row, u64 cursor col, u64 edits, per edit
+            u64 row, u64 before, u64 after, then the lines (u32 length, bytes)
+   index:   u64 offset of every record, oldest first, then the end of the
+            last one
+ The file is mapped read-only and nothing is decoded when it is opened;
+ undo decodes one record at a time, newest first, as it reaches them.
+ A save appends the records made since the file was opened over the tail
+ that is no longer reachable, then rewrites the index and header; the
+ version field is zeroed while that happens, so a file left half written
+ by a crash is rejected rather than misread.
+*/
+
+class UndoFile {
+private:
+    static constexpr std::uint32_t format_version = 1;
+
+    void* map = nullptr;
+    std::size_t map_size = 0;
+    std::size_t count = 0;
+    const std::uint64_t* index = nullptr;
+    std::uint64_t hash = 0;
+    // identity of the mapped file, to tell whether `path` still is that file
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+
+    UndoFile() = default;
+
+public:
+    ~UndoFile();
+    UndoFile(const UndoFile&) = delete;
+    UndoFile& operator=(const UndoFile&) = delete;
+
+    static std::string path_for(const std::string& filepath);
+    // nullptr if there is no usable file; only the header is read, check
+    // content_hash() before hashing the text to compare
+    static std::unique_ptr<UndoFile> open(const std::string& path);
+    // writes records [0, keep) of `older` (copied without decoding) followed
+    // by `newer`, through a temporary file renamed into place
+    static bool write(const std::string& path, std::uint64_t content_hash,
+                      const UndoFile* older, std::size_t keep,
+                      const std::vector<UndoRecord>& newer);
+    // the same result, written into `older` itself, which has to be the
+    // file at `path` (see maps()): records [0, keep) are left where they
+    // are. `older` must not be read afterwards, whether this succeeded or not
+    static bool append(const std::string& path, std::uint64_t content_hash,
+                       const UndoFile& older, std::size_t keep,
+                       const std::vector<UndoRecord>& newer);
+
+    // `path` is the file this one maps
+    bool maps(const std::string& path) const;
+    // of the text the history belongs to
+    std::uint64_t content_hash() const;
+
+    std::size_t size() const;
+    // nullopt if the record is damaged
+    std::optional<UndoRecord> decode(std::size_t i) const;
+    std::string_view raw(std::size_t i) const;
+};
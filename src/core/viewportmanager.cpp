@@ -42,6 +42,10 @@ std::size_t ViewportManager::get_view_offset() const {
     return view_offset;
 }
 
+void ViewportManager::set_view_offset(const std::size_t offset) {
+    view_offset = offset;
+}
+
 std::pair<std::size_t, std::size_t> ViewportManager::getVisibleRange() const {
     return {view_offset, view_offset + max_visible_rows};
 }
@@ -25,6 +25,7 @@ public:
     void adjust_viewport(const Cursor& modelPos);
 
     std::size_t get_view_offset() const;
+    void set_view_offset(std::size_t offset);
 
     std::pair<std::size_t, std::size_t> getVisibleRange() const;
     std::size_t get_max_row() const;
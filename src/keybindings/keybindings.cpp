@@ -1,53 +1,66 @@
 #include "keybindings.h"
 #include "../core/editor.h"
-#include <functional>
+#include <algorithm>
+#include <array>
 
 namespace Keybindings {
 
-std::unordered_map<std::string, std::function<void(Editor&)>> normal_keys = {
+namespace {
+
+// motions take a count ("100j") and jump straight to the target
+constexpr auto normal_bindings = std::to_array<KeyBinding>({
     {
         "h",
-        [](Editor& editor) { editor.get_cm().move_dir(Direction::Left); },
+        [](Editor& editor) {
+            editor.get_cm().move_cols(Direction::Left, editor.count_or(1));
+        },
     },
-    {"j", [](Editor& editor) { editor.get_cm().move_dir(Direction::Down); }},
-    {"k", [](Editor& editor) { editor.get_cm().move_dir(Direction::Up); }},
-    {"l",
+    {"j",
      [](Editor& editor) {
-         auto& cm = editor.get_cm();
-         if (const auto cursor = cm.get();
-             cursor.col < editor.get_buffer().get_line_length(cursor.row) - 1) {
-             cm.move_dir(Direction::Right);
-         }
+         editor.get_cm().move_rows(Direction::Down, editor.count_or(1));
      }},
-    {"i", [](Editor& editor) { editor.set_mode(Mode::Insert); }},
-    {"v", [](Editor& editor) { editor.set_mode(Mode::Visual); }},
-    {"a",
+    {"k",
      [](Editor& editor) {
-         auto& cm = editor.get_cm();
-         cm.move_dir(Direction::Right);
-         editor.set_mode(Mode::Insert);
+         editor.get_cm().move_rows(Direction::Up, editor.count_or(1));
      }},
-    {":", [](Editor& editor) { editor.set_mode(Mode::Command); }},
-
-    {"dd",
+    {"l",
      [](Editor& editor) {
-         const auto& buffer = editor.get_buffer();
-         auto& cm = editor.get_cm();
-         editor.get_buffer().delete_line(editor.get_cm());
-         if (cm.row() == buffer.line_count()) {
-             cm.move_dir(Direction::Up);
-         }
+         editor.get_cm().move_cols(Direction::Right, editor.count_or(1));
      }},
+    {"i", [](Editor& editor) { editor.start_insert(false); }},
+    {"v", [](Editor& editor) { editor.set_mode(Mode::Visual); }},
+    {"a", [](Editor& editor) { editor.start_insert(true); }},
+    {":", [](Editor& editor) { editor.set_mode(Mode::Command); }},
+    {"/", [](Editor& editor) { editor.start_search(true); }},
+    {"?", [](Editor& editor) { editor.start_search(false); }},
+    {"n", [](Editor& editor) { editor.search_next(false); }},
+    {"N", [](Editor& editor) { editor.search_next(true); }},
+    {"u", [](Editor& editor) { editor.undo(); }},
+    {"\x12", [](Editor& editor) { editor.redo(); }}, // Ctrl-r
+    {"q", [](Editor& editor) { editor.await_register('q'); }},
+    {"@", [](Editor& editor) { editor.await_register('@'); }},
+    {"\x1b", [](Editor& editor) { editor.cancel_grep(); }}, // Escape key
+
+    {"dd", [](Editor& editor) { editor.delete_lines(editor.count_or(1)); }},
+    {".", [](Editor& editor) { editor.repeat_change(); }},
 
+    // with a count both go to that line
     {"G",
      [](Editor& editor) {
          const auto& tb = editor.get_buffer();
-         editor.get_cm().move_abs({tb.line_count() - 1, 0});
+         const std::size_t line = std::min(editor.count_or(tb.line_count()),
+                                           tb.line_count());
+         editor.get_cm().move_abs({line - 1, 0});
+     }},
+    {"gg",
+     [](Editor& editor) {
+         const auto& tb = editor.get_buffer();
+         const std::size_t line = std::min(editor.count_or(1), tb.line_count());
+         editor.get_cm().move_abs({line - 1, 0});
      }},
-    {"gg", [](Editor& editor) { editor.get_cm().move_abs({0, 0}); }},
-};
+});
 
-std::unordered_map<std::string, std::function<void(Editor&)>> visual_keys = {
+constexpr auto visual_bindings = std::to_array<KeyBinding>({
     {"h",
      [](Editor& editor) {
          editor.get_cm().move_dir(Direction::Left);
@@ -80,18 +93,19 @@ std::unordered_map<std::string, std::function<void(Editor&)>> visual_keys = {
          editor.set_visual_end(editor.get_cm().get());
      }},
     {"v", [](Editor& editor) { editor.set_mode(Mode::Normal); }},
-    {"d",
-     [](Editor& editor) {
-         auto [visual_start, visual_end] = editor.get_visual_range();
-         const Cursor start_cursor = visual_start.value();
-         const Cursor end_cursor = visual_end.value();
-         editor.get_logger().log(std::to_string(start_cursor.row) + ", " +
-                                 std::to_string(start_cursor.col) + " : " + std::to_string(end_cursor.row) + ", " + std::to_string(end_cursor.col));
-         editor.get_buffer().delete_range(start_cursor, end_cursor);
-         editor.get_cm().move_abs(start_cursor);
-         editor.set_mode(Mode::Normal);
-     }},
+    {"d", [](Editor& editor) { editor.delete_selection(); }},
     {"\x1b",
      [](Editor& editor) { editor.set_mode(Mode::Normal); }}, // Escape key
-};
+});
+
+constexpr auto normal_trie =
+    compile_keymap<trie_size(normal_bindings)>(normal_bindings);
+constexpr auto visual_trie =
+    compile_keymap<trie_size(visual_bindings)>(visual_bindings);
+
+} // namespace
+
+extern const KeyNode* const normal_keys = normal_trie.nodes.data();
+extern const KeyNode* const visual_keys = visual_trie.nodes.data();
+
 } // namespace Keybindings
@@ -1,14 +1,10 @@
 #pragma once
 
 #include "../core/editor.h"
-#include <functional>
-#include <string_view>
-#include <unordered_map>
+#include "keymap.h"
 
 namespace Keybindings {
-//...
-extern std::unordered_map<std::string, std::function<void(Editor&)>>
-    normal_keys;
-extern std::unordered_map<std::string, std::function<void(Editor&)>>
-    visual_keys;
+// roots of the compiled key tries, see keymap.h
+extern const KeyNode* const normal_keys;
+extern const KeyNode* const visual_keys;
 } // namespace Keybindings
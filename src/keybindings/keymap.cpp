@@ -0,0 +1,47 @@
+#include "keymap.h"
+
+KeyDispatcher::KeyDispatcher(const KeyNode* nodes) : nodes(nodes) {}
+
+std::uint16_t KeyDispatcher::find(const std::uint16_t parent, const int key) const {
+    std::uint16_t child = nodes[parent].child;
+    while (child != 0 && nodes[child].key != key) {
+        child = nodes[child].sibling;
+    }
+    return child;
+}
+
+KeyDispatcher::Result KeyDispatcher::feed(const int key, KeyAction& action) {
+    const std::uint16_t child = find(node, key);
+    if (child == 0) {
+        if (node == 0) {
+            return Result::None;
+        }
+        // the key does not continue the sequence: a bound prefix still runs,
+        // and the key starts over from the root either way
+        action = nodes[node].action;
+        node = 0;
+        return action ? Result::Flush : feed(key, action);
+    }
+
+    if (nodes[child].child != 0) {
+        node = child;
+        return Result::Pending;
+    }
+    node = 0;
+    action = nodes[child].action;
+    return action ? Result::Run : Result::None;
+}
+
+KeyAction KeyDispatcher::expire() {
+    const KeyAction action = nodes[node].action;
+    node = 0;
+    return action;
+}
+
+bool KeyDispatcher::pending() const {
+    return node != 0;
+}
+
+void KeyDispatcher::reset() {
+    node = 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/*
+ Key sequences compiled into a trie at compile time.
+ A KeyDispatcher walks the trie one key at a time: sequences of any length,
+ a pending state between keys, and a timeout that settles a sequence which is
+ both a binding and the prefix of a longer one ("g" vs "gg"). Dispatch is a
+ sibling-list walk over a static array, nothing is allocated per key.
+*/
+
+class Editor;
+
+using KeyAction = void (*)(Editor&);
+
+struct KeyBinding {
+    std::string_view keys;
+    KeyAction action;
+};
+
+// children form a sibling list; index 0 is the root, so 0 also means "none"
+struct KeyNode {
+    int key = 0;
+    KeyAction action = nullptr;
+    std::uint16_t child = 0;
+    std::uint16_t sibling = 0;
+};
+
+template <std::size_t Nodes>
+struct Keymap {
+    std::array<KeyNode, Nodes> nodes{};
+    std::size_t used = 1;
+};
+
+// a pending sequence with no further key after this long runs as it is
+inline constexpr int sequence_timeout_ms = 1000;
+
+template <std::size_t Count>
+constexpr std::size_t trie_size(const std::array<KeyBinding, Count>& bindings) {
+    std::size_t size = 1;
+    for (const auto& binding : bindings) {
+        size += binding.keys.size();
+    }
+    return size;
+}
+
+// later bindings of the same sequence replace earlier ones
+template <std::size_t Nodes, std::size_t Count>
+consteval Keymap<Nodes> compile_keymap(const std::array<KeyBinding, Count>& bindings) {
+    Keymap<Nodes> map{};
+    for (const auto& binding : bindings) {
+        std::uint16_t node = 0;
+        for (const char c : binding.keys) {
+            const int key = static_cast<unsigned char>(c);
+            std::uint16_t child = map.nodes[node].child;
+            while (child != 0 && map.nodes[child].key != key) {
+                child = map.nodes[child].sibling;
+            }
+            if (child == 0) {
+                child = static_cast<std::uint16_t>(map.used++);
+                map.nodes[child].key = key;
+                map.nodes[child].sibling = map.nodes[node].child;
+                map.nodes[node].child = child;
+            }
+            node = child;
+        }
+        map.nodes[node].action = binding.action;
+    }
+    return map;
+}
+
+class KeyDispatcher {
+private:
+    const KeyNode* nodes;
+    std::uint16_t node = 0;
+
+    std::uint16_t find(std::uint16_t parent, int key) const;
+
+public:
+    enum class Result {
+        Run,     // `action` completes the sequence
+        Pending, // more keys may follow
+        Flush,   // run `action` for the pending prefix, then feed the key again
+        None,    // not bound, the sequence is dropped
+    };
+
+    explicit KeyDispatcher(const KeyNode* nodes);
+
+    Result feed(int key, KeyAction& action);
+    // the pending sequence timed out: its own binding, if it has one
+    KeyAction expire();
+    bool pending() const;
+    void reset();
+};
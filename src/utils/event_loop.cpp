@@ -0,0 +1,135 @@
+#include "event_loop.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+EventLoop::EventLoop()
+    : epoll_fd(::epoll_create1(EPOLL_CLOEXEC)),
+      wake_fd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+    if (valid()) {
+        add(wake_fd, [this] {
+            std::uint64_t count;
+            [[maybe_unused]] const auto n = ::read(wake_fd, &count, sizeof(count));
+            run_posted();
+        });
+    }
+}
+
+EventLoop::~EventLoop() {
+    for (const int timer : timers) {
+        ::close(timer);
+    }
+    if (wake_fd >= 0) {
+        ::close(wake_fd);
+    }
+    if (epoll_fd >= 0) {
+        ::close(epoll_fd);
+    }
+}
+
+bool EventLoop::valid() const {
+    return epoll_fd >= 0 && wake_fd >= 0;
+}
+
+bool EventLoop::add(const int fd, std::function<void()> on_ready) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        return false;
+    }
+    handlers[fd] = std::move(on_ready);
+    return true;
+}
+
+bool EventLoop::watch(const int fd, std::function<void()> on_ready) {
+    return fd >= 0 && add(fd, std::move(on_ready));
+}
+
+void EventLoop::unwatch(const int fd) {
+    if (handlers.erase(fd) > 0) {
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+int EventLoop::add_timer(std::function<void()> on_fire) {
+    const int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) {
+        return -1;
+    }
+    const bool added = add(fd, [fd, on_fire = std::move(on_fire)] {
+        std::uint64_t expirations;
+        if (::read(fd, &expirations, sizeof(expirations)) > 0) {
+            on_fire();
+        }
+    });
+    if (!added) {
+        ::close(fd);
+        return -1;
+    }
+    timers.push_back(fd);
+    return fd;
+}
+
+void EventLoop::arm_timer(const int timer, const int ms, const bool repeat) {
+    if (timer < 0) {
+        return;
+    }
+    itimerspec spec{};
+    spec.it_value = {ms / 1000, (ms % 1000) * 1'000'000L};
+    if (repeat) {
+        spec.it_interval = spec.it_value;
+    }
+    ::timerfd_settime(timer, 0, &spec, nullptr);
+}
+
+void EventLoop::remove_timer(const int timer) {
+    const auto it = std::find(timers.begin(), timers.end(), timer);
+    if (it != timers.end()) {
+        timers.erase(it);
+        unwatch(timer);
+        ::close(timer);
+    }
+}
+
+void EventLoop::post(std::function<void()> fn) {
+    {
+        std::lock_guard lock(posted_mtx);
+        posted.push_back(std::move(fn));
+    }
+    const std::uint64_t one = 1;
+    [[maybe_unused]] const auto n = ::write(wake_fd, &one, sizeof(one));
+}
+
+void EventLoop::run_posted() {
+    std::vector<std::function<void()>> batch;
+    {
+        std::lock_guard lock(posted_mtx);
+        batch.swap(posted);
+    }
+    for (auto& fn : batch) {
+        fn();
+    }
+}
+
+std::size_t EventLoop::wait(const int timeout_ms) {
+    std::array<epoll_event, 16> events{};
+    const int ready = ::epoll_wait(epoll_fd, events.data(),
+                                   static_cast<int>(events.size()), timeout_ms);
+    if (ready <= 0) {
+        return 0; // timeout, or EINTR from a signal such as SIGWINCH
+    }
+    for (int i = 0; i < ready; ++i) {
+        // a handler may have unwatched a later fd of the same batch
+        const auto it = handlers.find(events[static_cast<std::size_t>(i)].data.fd);
+        if (it != handlers.end()) {
+            const auto handler = it->second;
+            handler();
+        }
+    }
+    return static_cast<std::size_t>(ready);
+}
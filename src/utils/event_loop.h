@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// single-threaded epoll loop: readable fds (terminal input), timerfd timers
+// and callbacks posted from other threads through an eventfd, so the UI
+// thread sleeps until one of them has something for it
+class EventLoop {
+private:
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    std::unordered_map<int, std::function<void()>> handlers;
+    std::vector<int> timers; // owned, closed with the loop
+
+    std::mutex posted_mtx;
+    std::vector<std::function<void()>> posted;
+
+    bool add(int fd, std::function<void()> on_ready);
+    void run_posted();
+
+public:
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // false if epoll or the eventfd could not be created
+    bool valid() const;
+
+    // on_ready runs whenever fd is readable (level-triggered)
+    bool watch(int fd, std::function<void()> on_ready);
+    void unwatch(int fd);
+
+    // a disarmed timer, -1 on failure; the returned fd is its handle
+    int add_timer(std::function<void()> on_fire);
+    // fires once after ms (every ms if repeat); 0 disarms
+    void arm_timer(int timer, int ms, bool repeat = false);
+    void remove_timer(int timer);
+
+    // thread-safe, fn runs on the loop thread during the next wait()
+    void post(std::function<void()> fn);
+
+    // sleeps until something is ready or timeout_ms passes (negative blocks),
+    // runs the handlers; returns the number of events handled
+    std::size_t wait(int timeout_ms = -1);
+};
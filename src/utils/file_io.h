@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+// small POSIX helpers shared by the writers that must not lose data
+
+namespace file_io {
+
+// the whole of [data, data + size), retrying short writes and EINTR
+bool write_fully(int fd, const char* data, std::size_t size);
+// makes a rename or unlink inside `dir` durable
+void sync_dir(const std::string& dir);
+// the process umask, read without setting it where /proc allows
+mode_t current_umask();
+
+// appends a trivially copyable value in native byte order, for the binary
+// formats that never leave the machine (journal, undo file)
+template <typename T>
+void append_raw(std::string& out, const T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// FNV-1a over bytes, continuing from `hash`
+inline constexpr std::uint64_t hash_seed = 14695981039346656037ull;
+std::uint64_t hash_bytes(std::string_view bytes, std::uint64_t hash = hash_seed);
+
+} // namespace file_io
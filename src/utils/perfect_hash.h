@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+/*
+ Compile-time perfect hash set mapping words to a value.
+ The constructor searches for a seed under which no two words share a slot,
+ so a lookup is one hash, one length check and one compare. Construct it
+ constexpr so the search happens at build time; a set with no perfect seed
+ fails to compile.
+*/
+
+template <typename Value, std::size_t N>
+class PerfectHashMap {
+private:
+    // 8 slots per word keeps the expected seed search short
+    static constexpr std::size_t slot_count = std::bit_ceil(N * 8);
+    static constexpr std::size_t mask = slot_count - 1;
+    static constexpr std::uint32_t max_seed = 1u << 16;
+
+    std::array<std::string_view, slot_count> words{};
+    std::array<Value, slot_count> values{};
+    std::uint32_t seed = 0;
+    std::size_t max_length = 0;
+
+    static constexpr std::uint32_t hash(const std::string_view word,
+                                        const std::uint32_t seed) {
+        std::uint32_t h = seed ^ static_cast<std::uint32_t>(word.size()) *
+                                     0x9E3779B1u;
+        for (const char c : word) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 0x01000193u;
+        }
+        return h ^ (h >> 15);
+    }
+
+public:
+    consteval explicit PerfectHashMap(
+        const std::array<std::pair<std::string_view, Value>, N>& entries) {
+        for (std::uint32_t s = 1; s < max_seed; ++s) {
+            std::array<bool, slot_count> used{};
+            bool collision = false;
+            for (const auto& [word, _] : entries) {
+                auto& slot = used[hash(word, s) & mask];
+                if (slot) {
+                    collision = true;
+                    break;
+                }
+                slot = true;
+            }
+            if (collision) {
+                continue;
+            }
+
+            seed = s;
+            for (const auto& [word, value] : entries) {
+                const std::size_t idx = hash(word, s) & mask;
+                words[idx] = word;
+                values[idx] = value;
+                max_length = std::max(max_length, word.size());
+            }
+            return;
+        }
+        throw "PerfectHashMap: no collision-free seed found";
+    }
+
+    constexpr std::optional<Value> find(const std::string_view word) const {
+        if (word.empty() || word.size() > max_length) {
+            return std::nullopt;
+        }
+        const std::size_t idx = hash(word, seed) & mask;
+        if (words[idx] != word) {
+            return std::nullopt;
+        }
+        return values[idx];
+    }
+
+    constexpr bool contains(const std::string_view word) const {
+        return find(word).has_value();
+    }
+};
+
+template <typename Value, std::size_t N>
+consteval auto
+make_perfect_hash(const std::pair<std::string_view, Value> (&entries)[N]) {
+    return PerfectHashMap<Value, N>(std::to_array(entries));
+}
@@ -0,0 +1,662 @@
+#include "regex.h"
+#include "simd_scan.h"
+#include <algorithm>
+#include <utility>
+
+namespace regex {
+
+namespace {
+
+// what is known about the strings a fragment matches, in pattern order
+struct Literals {
+    std::optional<std::string> exact; // it matches only this string
+    std::string prefix;               // every match starts with it
+    std::string suffix;               // every match ends with it
+    std::string required;             // every match contains it
+};
+
+const std::string& longest(const std::string& a, const std::string& b) {
+    return b.size() > a.size() ? b : a;
+}
+
+Literals exactly(std::string text) {
+    return {text, text, text, text};
+}
+
+Literals concat(const Literals& a, const Literals& b) {
+    Literals both;
+    if (a.exact && b.exact) {
+        return exactly(*a.exact + *b.exact);
+    }
+    both.prefix = a.exact ? *a.exact + b.prefix : a.prefix;
+    both.suffix = b.exact ? a.suffix + *b.exact : b.suffix;
+    both.required = longest(longest(a.required, b.required), a.suffix + b.prefix);
+    both.required = longest(both.required, longest(both.prefix, both.suffix));
+    return both;
+}
+
+Literals either(const Literals& a, const Literals& b) {
+    if (a.exact && a.exact == b.exact) {
+        return a;
+    }
+    Literals any;
+    const auto common = std::mismatch(a.prefix.begin(), a.prefix.end(),
+                                      b.prefix.begin(), b.prefix.end());
+    any.prefix.assign(a.prefix.begin(), common.first);
+    const auto common_end = std::mismatch(a.suffix.rbegin(), a.suffix.rend(),
+                                          b.suffix.rbegin(), b.suffix.rend());
+    any.suffix.assign(common_end.first.base(), a.suffix.end());
+    any.required = a.required == b.required ? a.required : "";
+    any.required = longest(any.required, longest(any.prefix, any.suffix));
+    return any;
+}
+
+// a partially built automaton: its entry state and the exits still to patch
+struct Fragment {
+    int start;
+    std::vector<std::pair<int, bool>> outs; // (state, patch out1 instead of out)
+    Literals literals;
+};
+
+class Parser {
+private:
+    std::string_view pattern;
+    std::size_t pos = 0;
+    bool failed = false;
+    Nfa& nfa;
+    // builds the automaton of the mirrored pattern, for scanning right to
+    // left: concatenations run backwards and '^' / '$' trade places
+    bool reverse;
+
+    int add(const NfaState::Kind kind, const int out = -1, const int out1 = -1) {
+        nfa.states.push_back({kind, out, out1, {}});
+        return static_cast<int>(nfa.states.size() - 1);
+    }
+
+    void patch(const Fragment& frag, const int target) {
+        for (const auto& [state, second] : frag.outs) {
+            (second ? nfa.states[state].out1 : nfa.states[state].out) = target;
+        }
+    }
+
+    // the states that consume nothing match the empty string
+    Fragment single(const NfaState::Kind kind) {
+        const int s = add(kind);
+        return {s, {{s, false}}, exactly("")};
+    }
+
+    Fragment bytes(const std::bitset<256>& set) {
+        const int s = add(NfaState::Kind::Bytes);
+        nfa.states[s].bytes = set;
+        Fragment frag{s, {{s, false}}, {}};
+        if (set.count() == 1) {
+            for (int b = 0; b < 256; ++b) {
+                if (set.test(b)) {
+                    frag.literals = exactly(std::string(1, static_cast<char>(b)));
+                }
+            }
+        }
+        return frag;
+    }
+
+    static std::bitset<256> class_escape(const char c) {
+        std::bitset<256> set;
+        const auto add_if = [&](auto pred) {
+            for (int b = 0; b < 256; ++b) {
+                if (pred(b)) {
+                    set.set(b);
+                }
+            }
+        };
+        switch (c) {
+        case 'd': case 'D':
+            add_if([](const int b) { return b >= '0' && b <= '9'; });
+            break;
+        case 'w': case 'W':
+            add_if([](const int b) {
+                return b < 0x80 && scan::is(static_cast<char>(b), scan::Ident);
+            });
+            break;
+        case 's': case 'S':
+            add_if([](const int b) {
+                return scan::is(static_cast<char>(b), scan::Space);
+            });
+            break;
+        default:
+            break;
+        }
+        if (c == 'D' || c == 'W' || c == 'S') {
+            set.flip();
+        }
+        return set;
+    }
+
+    static bool is_class_escape(const char c) {
+        return c == 'd' || c == 'D' || c == 'w' || c == 'W' || c == 's' ||
+               c == 'S';
+    }
+
+    static char literal_escape(const char c) {
+        switch (c) {
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        default: return c;
+        }
+    }
+
+    Fragment bracket() {
+        std::bitset<256> set;
+        bool negate = false;
+        if (pos < pattern.size() && pattern[pos] == '^') {
+            negate = true;
+            ++pos;
+        }
+        bool first = true;
+        while (pos < pattern.size() && (pattern[pos] != ']' || first)) {
+            first = false;
+            char lo = pattern[pos++];
+            if (lo == '\\') {
+                if (pos == pattern.size()) {
+                    break;
+                }
+                const char esc = pattern[pos++];
+                if (is_class_escape(esc)) {
+                    set |= class_escape(esc);
+                    continue;
+                }
+                lo = literal_escape(esc);
+            }
+            char hi = lo;
+            if (pos + 1 < pattern.size() && pattern[pos] == '-' &&
+                pattern[pos + 1] != ']') {
+                hi = pattern[pos + 1];
+                pos += 2;
+            }
+            for (int b = static_cast<unsigned char>(lo);
+                 b <= static_cast<unsigned char>(hi); ++b) {
+                set.set(b);
+            }
+        }
+        if (pos == pattern.size()) {
+            failed = true; // unterminated class
+            return single(NfaState::Kind::Epsilon);
+        }
+        ++pos; // ']'
+        if (negate) {
+            set.flip();
+        }
+        return bytes(set);
+    }
+
+    Fragment atom() {
+        const char c = pattern[pos++];
+        std::bitset<256> set;
+        switch (c) {
+        case '(': {
+            Fragment inner = alternation();
+            if (pos == pattern.size() || pattern[pos] != ')') {
+                failed = true;
+                return inner;
+            }
+            ++pos;
+            return inner;
+        }
+        case '[':
+            return bracket();
+        case '.':
+            set.set();
+            set.reset('\n');
+            return bytes(set);
+        case '^':
+            return single(reverse ? NfaState::Kind::Eol : NfaState::Kind::Bol);
+        case '$':
+            return single(reverse ? NfaState::Kind::Bol : NfaState::Kind::Eol);
+        case '\\':
+            if (pos == pattern.size()) {
+                failed = true;
+                return single(NfaState::Kind::Epsilon);
+            }
+            if (is_class_escape(pattern[pos])) {
+                return bytes(class_escape(pattern[pos++]));
+            }
+            set.set(static_cast<unsigned char>(literal_escape(pattern[pos++])));
+            return bytes(set);
+        default:
+            set.set(static_cast<unsigned char>(c));
+            return bytes(set);
+        }
+    }
+
+    Fragment repetition() {
+        Fragment frag = atom();
+        while (pos < pattern.size() &&
+               (pattern[pos] == '*' || pattern[pos] == '+' ||
+                pattern[pos] == '?')) {
+            const char op = pattern[pos++];
+            const int split = add(NfaState::Kind::Split, frag.start);
+            // one or more copies keep the ends and what is required
+            if (op == '+') {
+                frag.literals.exact.reset();
+            } else {
+                frag.literals = {};
+            }
+            if (op == '*') {
+                patch(frag, split);
+                frag = {split, {{split, true}}, {}};
+            } else if (op == '+') {
+                patch(frag, split);
+                frag = {frag.start, {{split, true}}, std::move(frag.literals)};
+            } else {
+                frag.outs.emplace_back(split, true);
+                frag.start = split;
+            }
+        }
+        return frag;
+    }
+
+    Fragment concatenation() {
+        std::optional<Fragment> result;
+        while (pos < pattern.size() && pattern[pos] != '|' &&
+               pattern[pos] != ')') {
+            Fragment next = repetition();
+            if (result) {
+                result->literals = concat(result->literals, next.literals);
+            }
+            if (result && reverse) {
+                patch(next, result->start);
+                result->start = next.start;
+            } else if (result) {
+                patch(*result, next.start);
+                result->outs = std::move(next.outs);
+            } else {
+                result = std::move(next);
+            }
+        }
+        return result ? std::move(*result) : single(NfaState::Kind::Epsilon);
+    }
+
+    Fragment alternation() {
+        Fragment left = concatenation();
+        while (pos < pattern.size() && pattern[pos] == '|') {
+            ++pos;
+            Fragment right = concatenation();
+            const int split = add(NfaState::Kind::Split, left.start, right.start);
+            left.start = split;
+            left.outs.insert(left.outs.end(), right.outs.begin(),
+                             right.outs.end());
+            left.literals = either(left.literals, right.literals);
+        }
+        return left;
+    }
+
+public:
+    Parser(const std::string_view pattern, Nfa& nfa, const bool reverse = false)
+        : pattern(pattern), nfa(nfa), reverse(reverse) {}
+
+    bool parse() {
+        Fragment frag = alternation();
+        if (pos != pattern.size()) {
+            failed = true; // stray ')'
+        }
+        patch(frag, add(NfaState::Kind::Match));
+        nfa.start = frag.start;
+        nfa.required = std::move(frag.literals.required);
+        return !failed;
+    }
+};
+
+bool is_plain_literal(const std::string_view pattern) {
+    return !pattern.empty() &&
+           pattern.find_first_of(".[]()|*+?^$\\") == std::string_view::npos;
+}
+
+} // namespace
+
+Regex::Regex(std::shared_ptr<const Nfa> compiled, std::shared_ptr<const Nfa> mirrored)
+    : nfa(std::move(compiled)), reversed(std::move(mirrored)) {}
+
+std::optional<Regex> Regex::compile(const std::string_view pattern) {
+    auto nfa = std::make_shared<Nfa>();
+    auto reversed = std::make_shared<Nfa>();
+    if (!Parser(pattern, *nfa).parse() || !Parser(pattern, *reversed, true).parse()) {
+        return std::nullopt;
+    }
+    if (is_plain_literal(pattern)) {
+        nfa->literal = std::string(pattern);
+    }
+    return Regex(std::move(nfa), std::move(reversed));
+}
+
+const Nfa& Regex::program() const {
+    return *nfa;
+}
+
+const Nfa& Regex::reversed_program() const {
+    return *reversed;
+}
+
+const std::optional<std::string>& Regex::literal() const {
+    return nfa->literal;
+}
+
+bool Regex::anchors_end() const {
+    return std::any_of(nfa->states.begin(), nfa->states.end(), [](const NfaState& s) {
+        return s.kind == NfaState::Kind::Eol;
+    });
+}
+
+const std::string& Regex::required() const {
+    return nfa->required;
+}
+
+LazyDfa::LazyDfa(const Nfa& nfa, const bool unanchored)
+    : nfa(nfa), unanchored(unanchored) {}
+
+// follows epsilon edges from `state`; keeps consuming, Match and unresolved
+// Eol states (an Eol can still pass once the end of the line is reached)
+void LazyDfa::closure(const int state, const bool bol, const bool eol,
+                      std::vector<int>& out, std::vector<bool>& seen) const {
+    if (state < 0 || seen[state]) {
+        return;
+    }
+    seen[state] = true;
+    const NfaState& s = nfa.states[state];
+    switch (s.kind) {
+    case NfaState::Kind::Bytes:
+    case NfaState::Kind::Match:
+        out.push_back(state);
+        break;
+    case NfaState::Kind::Split:
+        closure(s.out, bol, eol, out, seen);
+        closure(s.out1, bol, eol, out, seen);
+        break;
+    case NfaState::Kind::Epsilon:
+        closure(s.out, bol, eol, out, seen);
+        break;
+    case NfaState::Kind::Bol:
+        if (bol) {
+            closure(s.out, bol, eol, out, seen);
+        }
+        break;
+    case NfaState::Kind::Eol:
+        if (eol) {
+            closure(s.out, bol, eol, out, seen);
+        } else {
+            out.push_back(state);
+        }
+        break;
+    }
+}
+
+void LazyDfa::reset() {
+    ++resets;
+    ids.clear();
+    sets.clear();
+    next.clear();
+    accepting.clear();
+    accepting_at_end.clear();
+    starts = {-1, -1};
+}
+
+int LazyDfa::intern(std::vector<int> set) {
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+    if (const auto it = ids.find(set); it != ids.end()) {
+        return it->second;
+    }
+    // the cache is bounded: start over rather than grow without limit
+    if (sets.size() >= max_states) {
+        reset();
+    }
+
+    const int id = static_cast<int>(sets.size());
+    bool accepts = false;
+    for (const int s : set) {
+        accepts |= nfa.states[s].kind == NfaState::Kind::Match;
+    }
+    ids.emplace(set, id);
+    sets.push_back(std::move(set));
+    std::array<int, 256> row{};
+    row.fill(-1);
+    next.push_back(row);
+    accepting.push_back(accepts);
+    accepting_at_end.push_back(-1);
+    return id;
+}
+
+int LazyDfa::start(const bool at_line_start) {
+    int& id = starts[at_line_start];
+    if (id < 0) {
+        std::vector<int> set;
+        std::vector<bool> seen(nfa.states.size());
+        closure(nfa.start, at_line_start, false, set, seen);
+        id = intern(std::move(set));
+        // intern() may have reset the cache and with it `starts`
+        starts[at_line_start] = id;
+    }
+    return starts[at_line_start];
+}
+
+int LazyDfa::step(const int state, const unsigned char byte) {
+    if (const int known = next[state][byte]; known >= 0) {
+        return known;
+    }
+
+    std::vector<int> set;
+    std::vector<bool> seen(nfa.states.size());
+    for (const int s : sets[state]) {
+        const NfaState& ns = nfa.states[s];
+        if (ns.kind == NfaState::Kind::Bytes && ns.bytes.test(byte)) {
+            closure(ns.out, false, false, set, seen);
+        }
+    }
+    if (unanchored) {
+        closure(nfa.start, false, false, set, seen);
+    }
+
+    const std::size_t before = resets;
+    const int id = intern(std::move(set));
+    // a reset invalidated `state`, the edge is simply not cached
+    if (resets == before) {
+        next[state][byte] = id;
+    }
+    return id;
+}
+
+bool LazyDfa::is_dead(const int state) const {
+    return sets[state].empty();
+}
+
+bool LazyDfa::is_accepting(const int state) const {
+    return accepting[state];
+}
+
+bool LazyDfa::is_accepting_at_end(const int state) {
+    if (accepting_at_end[state] < 0) {
+        std::vector<int> set;
+        std::vector<bool> seen(nfa.states.size());
+        for (const int s : sets[state]) {
+            if (nfa.states[s].kind == NfaState::Kind::Eol) {
+                closure(nfa.states[s].out, false, true, set, seen);
+            }
+        }
+        bool accepts = accepting[state];
+        for (const int s : set) {
+            accepts |= nfa.states[s].kind == NfaState::Kind::Match;
+        }
+        accepting_at_end[state] = accepts;
+    }
+    return accepting_at_end[state];
+}
+
+Matcher::Matcher(const Regex& regex)
+    : regex(regex), search(this->regex.program(), true),
+      anchor(this->regex.program(), false),
+      backward(this->regex.reversed_program(), true) {}
+
+bool Matcher::contains(const std::string_view line) {
+    if (const auto& literal = regex.literal()) {
+        return scan::find(line.data(), line.data() + line.size(), *literal) !=
+               line.data() + line.size();
+    }
+    const std::string& required = regex.required();
+    if (!required.empty() &&
+        scan::find(line.data(), line.data() + line.size(), required) ==
+            line.data() + line.size()) {
+        return false;
+    }
+
+    int state = search.start(true);
+    for (const char c : line) {
+        if (search.is_accepting(state)) {
+            return true;
+        }
+        state = search.step(state, static_cast<unsigned char>(c));
+    }
+    return search.is_accepting(state) || search.is_accepting_at_end(state);
+}
+
+std::optional<std::size_t> Matcher::match_at(const std::string_view line,
+                                             const std::size_t start) {
+    if (const auto& literal = regex.literal()) {
+        if (line.substr(start).starts_with(*literal)) {
+            return literal->size();
+        }
+        return std::nullopt;
+    }
+
+    if (start > line.size()) {
+        return std::nullopt;
+    }
+    std::optional<std::size_t> longest;
+    int state = anchor.start(start == 0);
+    for (std::size_t i = start; i < line.size(); ++i) {
+        if (anchor.is_accepting(state)) {
+            longest = i - start;
+        }
+        state = anchor.step(state, static_cast<unsigned char>(line[i]));
+        if (anchor.is_dead(state)) {
+            return longest;
+        }
+    }
+    if (anchor.is_accepting_at_end(state)) {
+        longest = line.size() - start;
+    }
+    return longest;
+}
+
+template <typename OnStart>
+void Matcher::for_each_start(const std::string_view line, const std::size_t lo,
+                             std::size_t hi, OnStart on_start) {
+    // an empty match can start at the end of the line ("$")
+    hi = std::min(hi, line.size() + 1);
+    if (lo >= hi) {
+        return;
+    }
+    // the state after reading line[col, size) backwards; '^' reads as an
+    // end-of-line anchor in the mirrored pattern, so col 0 resolves it
+    int state = backward.start(true);
+    for (std::size_t col = line.size();; --col) {
+        if (col < hi &&
+            (col == 0 ? backward.is_accepting_at_end(state) : backward.is_accepting(state)) &&
+            !on_start(col)) {
+            return;
+        }
+        if (col == lo) {
+            return;
+        }
+        state = backward.step(state, static_cast<unsigned char>(line[col - 1]));
+    }
+}
+
+std::optional<Match> Matcher::find_first(const std::string_view line,
+                                         const std::size_t lo,
+                                         const std::size_t hi) {
+    const std::size_t end = std::min(hi, line.size());
+    if (const auto& literal = regex.literal()) {
+        const char* begin = line.data() + std::min(lo, end);
+        const char* limit =
+            line.data() + std::min(line.size(), end + literal->size() - 1);
+        const char* hit = scan::find(begin, limit, *literal);
+        if (hit == limit) {
+            return std::nullopt;
+        }
+        return Match{static_cast<std::size_t>(hit - line.data()),
+                     literal->size()};
+    }
+
+    // the leftmost start is the last one the right-to-left pass reaches
+    std::optional<std::size_t> first;
+    for_each_start(line, lo, hi, [&](const std::size_t col) {
+        first = col;
+        return true;
+    });
+    if (const auto length = first ? match_at(line, *first) : std::nullopt) {
+        return Match{*first, *length};
+    }
+    return std::nullopt;
+}
+
+std::optional<Match> Matcher::find_last(const std::string_view line,
+                                        const std::size_t lo,
+                                        const std::size_t hi) {
+    const std::size_t end = std::min(hi, line.size());
+    if (const auto& literal = regex.literal()) {
+        const char* begin = line.data() + std::min(lo, end);
+        const char* limit =
+            line.data() + std::min(line.size(), end + literal->size() - 1);
+        const char* hit = scan::rfind(begin, limit, *literal);
+        if (hit == limit) {
+            return std::nullopt;
+        }
+        return Match{static_cast<std::size_t>(hit - line.data()),
+                     literal->size()};
+    }
+
+    std::optional<std::size_t> last;
+    for_each_start(line, lo, hi, [&](const std::size_t col) {
+        last = col;
+        return false;
+    });
+    if (const auto length = last ? match_at(line, *last) : std::nullopt) {
+        return Match{*last, *length};
+    }
+    return std::nullopt;
+}
+
+void Matcher::find_all(const std::string_view line, std::vector<Match>& out) {
+    // the whole-line DFA pass rejects most lines without locating anything
+    if (!contains(line)) {
+        return;
+    }
+    if (regex.literal()) {
+        std::size_t start = 0;
+        while (const auto match = find_first(line, start, SIZE_MAX)) {
+            out.push_back(*match);
+            start = match->start + match->length;
+        }
+        return;
+    }
+
+    // one right-to-left pass finds every start, then only those are tried
+    std::vector<bool> starts(line.size() + 1);
+    for_each_start(line, 0, SIZE_MAX, [&](const std::size_t col) {
+        starts[col] = true;
+        return true;
+    });
+    for (std::size_t col = 0; col <= line.size(); ++col) {
+        if (!starts[col]) {
+            continue;
+        }
+        const auto length = match_at(line, col);
+        if (!length) {
+            continue;
+        }
+        out.push_back({col, *length});
+        // past an empty match by one, or it would be found again
+        col += std::max<std::size_t>(*length, 1) - 1;
+    }
+}
+
+} // namespace regex
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ Line-oriented regular expressions matched with a lazily built DFA.
+ Locating a match takes two linear passes: the DFA of the mirrored pattern
+ runs from the end of the line to the left and accepts at every column a
+ match starts at, then the anchored DFA runs from the chosen start to find
+ the longest match there.
+ Supported: literals, '.', [classes] with ranges and '^' negation, \d \w \s
+ (and \D \W \S), grouping, '|', '*', '+', '?', and the anchors '^' / '$'.
+ Matches are leftmost-longest and may be empty ("^", "$", "x*"): an empty
+ match sits before the byte it starts at, or past the last one. A Regex is immutable and can be shared between
+ threads; each thread scans with its own Matcher, which owns the DFA cache.
+*/
+
+namespace regex {
+
+struct NfaState {
+    enum class Kind : std::uint8_t {
+        Bytes,   // consume one byte from `bytes`, then `out`
+        Split,   // epsilon to `out` and `out1`
+        Epsilon, // epsilon to `out`
+        Bol,     // passes only at the start of the line
+        Eol,     // passes only at the end of the line
+        Match,
+    };
+
+    Kind kind;
+    int out = -1;
+    int out1 = -1;
+    std::bitset<256> bytes;
+};
+
+struct Nfa {
+    std::vector<NfaState> states;
+    int start = -1;
+    // set when the pattern has no operators, matched with scan::find instead
+    std::optional<std::string> literal;
+    // a string every match contains, empty if there is none; lines without
+    // it are skipped with scan::find before the DFA runs
+    std::string required;
+};
+
+struct Match {
+    std::size_t start;
+    std::size_t length;
+};
+
+class Regex {
+private:
+    std::shared_ptr<const Nfa> nfa;
+    std::shared_ptr<const Nfa> reversed; // of the mirrored pattern
+
+    Regex(std::shared_ptr<const Nfa> compiled, std::shared_ptr<const Nfa> mirrored);
+
+public:
+    // nullopt if the pattern does not parse (unbalanced parens, dangling '\')
+    static std::optional<Regex> compile(std::string_view pattern);
+
+    const Nfa& program() const;
+    // matches the pattern read right to left, with '^' and '$' swapped
+    const Nfa& reversed_program() const;
+    const std::optional<std::string>& literal() const;
+    // uses '$', so a match depends on where the line ends
+    bool anchors_end() const;
+    // bytes every match contains ("fooba" in "\w+foo(bar|baz)"), may be empty
+    const std::string& required() const;
+};
+
+class LazyDfa {
+private:
+    static constexpr std::size_t max_states = 2048;
+
+    const Nfa& nfa;
+    bool unanchored; // restarts the NFA at every byte, i.e. a leading .*
+
+    std::map<std::vector<int>, int> ids;
+    std::vector<std::vector<int>> sets;
+    std::vector<std::array<int, 256>> next;
+    std::vector<bool> accepting;
+    std::vector<std::int8_t> accepting_at_end; // -1 until computed
+    std::array<int, 2> starts{-1, -1};         // indexed by "at line start"
+    std::size_t resets = 0;
+
+    void closure(int state, bool bol, bool eol, std::vector<int>& out,
+                 std::vector<bool>& seen) const;
+    int intern(std::vector<int> set);
+    void reset();
+
+public:
+    LazyDfa(const Nfa& nfa, bool unanchored);
+
+    int start(bool at_line_start);
+    int step(int state, unsigned char byte);
+    bool is_dead(int state) const;
+    bool is_accepting(int state) const;
+    bool is_accepting_at_end(int state);
+};
+
+class Matcher {
+private:
+    Regex regex;
+    LazyDfa search;   // does the line match at all
+    LazyDfa anchor;   // longest match from a fixed start
+    LazyDfa backward; // where matches start, scanning right to left
+
+    // calls on_start(col), right to left, for every col in [lo, hi) that a
+    // match starts at, until it returns false
+    template <typename OnStart>
+    void for_each_start(std::string_view line, std::size_t lo, std::size_t hi,
+                        OnStart on_start);
+
+public:
+    explicit Matcher(const Regex& regex);
+
+    Matcher(const Matcher&) = delete;
+    Matcher& operator=(const Matcher&) = delete;
+
+    bool contains(std::string_view line);
+    // length of the longest match starting at `start`, 0 for an empty one
+    std::optional<std::size_t> match_at(std::string_view line,
+                                        std::size_t start);
+    // non-overlapping leftmost-longest matches, appended to `out`; the
+    // search goes on one byte past an empty match
+    void find_all(std::string_view line, std::vector<Match>& out);
+    // first match starting in [lo, hi) / last match starting in [lo, hi);
+    // starts run up to line.size() inclusive
+    std::optional<Match> find_first(std::string_view line, std::size_t lo,
+                                    std::size_t hi);
+    std::optional<Match> find_last(std::string_view line, std::size_t lo,
+                                   std::size_t hi);
+};
+
+} // namespace regex
@@ -0,0 +1,343 @@
+#include "simd_scan.h"
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace scan {
+
+namespace {
+
+constexpr std::array<std::uint8_t, 256> build_char_class() {
+    std::array<std::uint8_t, 256> table{};
+    for (int c = 0; c < 256; ++c) {
+        std::uint8_t cls = 0;
+        const bool lower = c >= 'a' && c <= 'z';
+        const bool upper = c >= 'A' && c <= 'Z';
+        const bool digit = c >= '0' && c <= '9';
+        if (lower || upper || digit || c == '_') {
+            cls |= Ident;
+        }
+        if (digit) {
+            cls |= Digit;
+        }
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+            cls |= Space;
+        }
+        if (c > ' ' && c < 0x7f && !(lower || upper || digit || c == '_')) {
+            cls |= Punct;
+        }
+        if (c >= 0x80) {
+            cls |= High;
+        }
+        table[c] = cls;
+    }
+    return table;
+}
+
+template <typename Pred>
+const char* skip_while(const char* p, const char* end, Pred pred) {
+    if (p >= end) {
+        return end;
+    }
+    while (p < end && pred(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+} // namespace
+
+const std::array<std::uint8_t, 256> char_class = build_char_class();
+
+namespace scalar {
+
+const char* skip_ident(const char* p, const char* end) {
+    return skip_while(p, end, [](const char c) { return is(c, Ident); });
+}
+
+const char* skip_space(const char* p, const char* end) {
+    return skip_while(p, end, [](const char c) { return is(c, Space); });
+}
+
+const char* skip_high(const char* p, const char* end) {
+    return skip_while(p, end, [](const char c) { return is(c, High); });
+}
+
+const char* find_either(const char* p, const char* end, const char a,
+                        const char b) {
+    return skip_while(p, end, [=](const char c) { return c != a && c != b; });
+}
+
+const char* find(const char* p, const char* end,
+                 const std::string_view needle) {
+    if (p >= end) {
+        return end;
+    }
+    if (needle.empty()) {
+        return p;
+    }
+    while (static_cast<std::size_t>(end - p) >= needle.size()) {
+        p = static_cast<const char*>(
+            std::memchr(p, needle[0], end - p - needle.size() + 1));
+        if (!p) {
+            return end;
+        }
+        if (std::memcmp(p, needle.data(), needle.size()) == 0) {
+            return p;
+        }
+        ++p;
+    }
+    return end;
+}
+
+const char* rfind(const char* p, const char* end,
+                  const std::string_view needle) {
+    if (p >= end || static_cast<std::size_t>(end - p) < needle.size()) {
+        return end;
+    }
+    for (const char* s = end - needle.size();; --s) {
+        if (std::memcmp(s, needle.data(), needle.size()) == 0) {
+            return s;
+        }
+        if (s == p) {
+            return end;
+        }
+    }
+}
+
+} // namespace scalar
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+namespace {
+
+#if defined(__AVX2__)
+using Vec = __m256i;
+constexpr std::size_t width = 32;
+
+Vec load(const char* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+Vec splat(const char c) {
+    return _mm256_set1_epi8(c);
+}
+Vec eq(const Vec a, const Vec b) {
+    return _mm256_cmpeq_epi8(a, b);
+}
+Vec gt(const Vec a, const Vec b) {
+    return _mm256_cmpgt_epi8(a, b);
+}
+Vec band(const Vec a, const Vec b) {
+    return _mm256_and_si256(a, b);
+}
+Vec bor(const Vec a, const Vec b) {
+    return _mm256_or_si256(a, b);
+}
+std::uint32_t mask(const Vec v) {
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(v));
+}
+#else
+using Vec = __m128i;
+constexpr std::size_t width = 16;
+
+Vec load(const char* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+Vec splat(const char c) {
+    return _mm_set1_epi8(c);
+}
+Vec eq(const Vec a, const Vec b) {
+    return _mm_cmpeq_epi8(a, b);
+}
+Vec gt(const Vec a, const Vec b) {
+    return _mm_cmpgt_epi8(a, b);
+}
+Vec band(const Vec a, const Vec b) {
+    return _mm_and_si128(a, b);
+}
+Vec bor(const Vec a, const Vec b) {
+    return _mm_or_si128(a, b);
+}
+std::uint32_t mask(const Vec v) {
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(v));
+}
+#endif
+
+constexpr std::uint32_t full_mask =
+    width == 32 ? 0xFFFFFFFFu : (1u << width) - 1;
+
+// lo <= v <= hi; compares are signed, so bytes >= 0x80 never match
+Vec in_range(const Vec v, const char lo, const char hi) {
+    return band(gt(v, splat(static_cast<char>(lo - 1))),
+                gt(splat(static_cast<char>(hi + 1)), v));
+}
+
+// runs `classify` over full vectors, returns at the first byte outside the
+// class; the tail is left to the scalar version
+template <typename Classify, typename Tail>
+const char* skip_vec(const char* p, const char* end, Classify classify,
+                     Tail tail) {
+    if (p >= end) {
+        return end;
+    }
+    while (static_cast<std::size_t>(end - p) >= width) {
+        const std::uint32_t outside = ~mask(classify(load(p))) & full_mask;
+        if (outside) {
+            return p + __builtin_ctz(outside);
+        }
+        p += width;
+    }
+    return tail(p, end);
+}
+
+} // namespace
+
+const char* skip_ident(const char* p, const char* end) {
+    return skip_vec(
+        p, end,
+        [](const Vec v) {
+            const Vec lower = bor(v, splat(0x20));
+            return bor(bor(in_range(lower, 'a', 'z'), in_range(v, '0', '9')),
+                       eq(v, splat('_')));
+        },
+        scalar::skip_ident);
+}
+
+const char* skip_space(const char* p, const char* end) {
+    return skip_vec(
+        p, end,
+        [](const Vec v) {
+            return bor(eq(v, splat(' ')), in_range(v, '\t', '\r'));
+        },
+        scalar::skip_space);
+}
+
+const char* skip_high(const char* p, const char* end) {
+    return skip_vec(
+        p, end, [](const Vec v) { return gt(splat(0), v); },
+        scalar::skip_high);
+}
+
+const char* find_either(const char* p, const char* end, const char a,
+                        const char b) {
+    if (p >= end) {
+        return end;
+    }
+    const Vec va = splat(a);
+    const Vec vb = splat(b);
+    while (static_cast<std::size_t>(end - p) >= width) {
+        const Vec v = load(p);
+        if (const std::uint32_t hit = mask(bor(eq(v, va), eq(v, vb)))) {
+            return p + __builtin_ctz(hit);
+        }
+        p += width;
+    }
+    return scalar::find_either(p, end, a, b);
+}
+
+// candidate starts in [base, base + width) whose first and last bytes match
+std::uint32_t candidates(const char* base, const std::string_view needle) {
+    const Vec first = eq(load(base), splat(needle.front()));
+    const Vec last = eq(load(base + needle.size() - 1), splat(needle.back()));
+    return mask(band(first, last));
+}
+
+bool matches_at(const char* s, const std::string_view needle) {
+    // first and last bytes are already known to match
+    return needle.size() <= 2 ||
+           std::memcmp(s + 1, needle.data() + 1, needle.size() - 2) == 0;
+}
+
+const char* find(const char* p, const char* end,
+                 const std::string_view needle) {
+    if (p >= end) {
+        return end;
+    }
+    if (needle.size() < 2) {
+        return needle.empty() ? p
+                              : find_either(p, end, needle[0], needle[0]);
+    }
+    // both loads must stay inside [p, end)
+    while (static_cast<std::size_t>(end - p) >= width + needle.size() - 1) {
+        for (std::uint32_t hits = candidates(p, needle); hits;
+             hits &= hits - 1) {
+            const char* s = p + __builtin_ctz(hits);
+            if (matches_at(s, needle)) {
+                return s;
+            }
+        }
+        p += width;
+    }
+    return scalar::find(p, end, needle);
+}
+
+const char* rfind(const char* p, const char* end,
+                  const std::string_view needle) {
+    if (p >= end || needle.empty() ||
+        static_cast<std::size_t>(end - p) < needle.size()) {
+        return end;
+    }
+    // candidate starts are [p, last]; walk whole blocks down from the top
+    std::size_t last = static_cast<std::size_t>(end - p) - needle.size();
+    while (last + 1 >= width) {
+        const char* base = p + last + 1 - width;
+        for (std::uint32_t hits = candidates(base, needle); hits;
+             hits &= ~(1u << (31 - __builtin_clz(hits)))) {
+            const char* s = base + (31 - __builtin_clz(hits));
+            if (matches_at(s, needle)) {
+                return s;
+            }
+        }
+        if (last + 1 == width) {
+            return end;
+        }
+        last -= width;
+    }
+    const char* found = scalar::rfind(p, p + last + needle.size(), needle);
+    return found == p + last + needle.size() ? end : found;
+}
+
+const char* backend() {
+    return width == 32 ? "avx2" : "sse2";
+}
+
+#else
+
+const char* skip_ident(const char* p, const char* end) {
+    return scalar::skip_ident(p, end);
+}
+
+const char* skip_space(const char* p, const char* end) {
+    return scalar::skip_space(p, end);
+}
+
+const char* skip_high(const char* p, const char* end) {
+    return scalar::skip_high(p, end);
+}
+
+const char* find_either(const char* p, const char* end, const char a,
+                        const char b) {
+    return scalar::find_either(p, end, a, b);
+}
+
+const char* find(const char* p, const char* end,
+                 const std::string_view needle) {
+    return scalar::find(p, end, needle);
+}
+
+const char* rfind(const char* p, const char* end,
+                  const std::string_view needle) {
+    return scalar::rfind(p, end, needle);
+}
+
+const char* backend() {
+    return "scalar";
+}
+
+#endif
+
+} // namespace scan
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/*
+ Bulk character-class scanning for the lexer and substring search.
+ The skip_* functions return the first position in [p, end) that does NOT
+ belong to the run (or end); every function returns end for an empty or
+ overrun range (p >= end). The vector paths classify 32 (AVX2) or 16 (SSE2) bytes
+ per step; the scalar versions are always compiled for other targets and so
+ the benchmark can compare against them.
+*/
+
+namespace scan {
+
+enum CharClass : std::uint8_t {
+    Ident = 1 << 0, // [A-Za-z0-9_]
+    Space = 1 << 1, // ' ', \t, \n, \v, \f, \r
+    Digit = 1 << 2,
+    Punct = 1 << 3, // ASCII punctuation except '_'
+    High = 1 << 4,  // bytes >= 0x80 (UTF-8 sequences)
+};
+
+// 256 entry lookup used by the scalar paths and per-byte dispatch
+extern const std::array<std::uint8_t, 256> char_class;
+
+inline bool is(const char c, const CharClass cls) {
+    return char_class[static_cast<unsigned char>(c)] & cls;
+}
+
+const char* skip_ident(const char* p, const char* end);
+const char* skip_space(const char* p, const char* end);
+const char* skip_high(const char* p, const char* end);
+// first occurrence of a or b
+const char* find_either(const char* p, const char* end, char a, char b);
+// first/last start of needle in [p, end), or end if there is none; candidates
+// are filtered on the needle's first and last byte, then verified
+const char* find(const char* p, const char* end, std::string_view needle);
+const char* rfind(const char* p, const char* end, std::string_view needle);
+
+// name of the vector path selected at build time ("avx2", "sse2", "scalar")
+const char* backend();
+
+namespace scalar {
+const char* skip_ident(const char* p, const char* end);
+const char* skip_space(const char* p, const char* end);
+const char* skip_high(const char* p, const char* end);
+const char* find_either(const char* p, const char* end, char a, char b);
+const char* find(const char* p, const char* end, std::string_view needle);
+const char* rfind(const char* p, const char* end, std::string_view needle);
+} // namespace scalar
+
+} // namespace scan
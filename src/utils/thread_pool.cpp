@@ -0,0 +1,44 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(std::size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([this] { work(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+std::size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+void ThreadPool::work() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock lock(mtx);
+            cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+            // queued jobs still run, their futures may be waited on
+            if (jobs.empty()) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop();
+        }
+        job();
+    }
+}
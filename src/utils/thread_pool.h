@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// fixed set of workers draining a FIFO of jobs, used for bulk scans that the
+// UI thread waits on (search, grep)
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    void work();
+
+public:
+    // 0 picks std::thread::hardware_concurrency()
+    explicit ThreadPool(std::size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t size() const;
+
+    template <typename Fn>
+    std::future<std::invoke_result_t<Fn>> submit(Fn fn) {
+        // std::function needs a copyable target, the task itself is move-only
+        auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Fn>()>>(
+            std::move(fn));
+        auto future = task->get_future();
+        {
+            std::lock_guard lock(mtx);
+            jobs.emplace([task] { (*task)(); });
+        }
+        cv.notify_one();
+        return future;
+    }
+};
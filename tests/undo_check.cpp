@@ -0,0 +1,57 @@
+#include "../src/core/buffer.h"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+ Undo regressions that the editor cannot show by itself.
+ Usage: undo_check [scratch_file]
+*/
+
+namespace {
+
+std::vector<std::string> rows_of(const Buffer& buffer) {
+    std::vector<std::string> rows;
+    for (std::size_t row = 0; row < buffer.line_count(); ++row) {
+        rows.push_back(buffer.get_line(row));
+    }
+    return rows;
+}
+
+// one group editing rows r, r + 1 and r again, as a replayed macro does:
+// the edits are not folded and undo must take them back in reverse
+bool same_row_twice(const std::string& path) {
+    std::ofstream(path) << "one\ntwo\nthree\n";
+    Buffer buffer(path);
+    const auto original = rows_of(buffer);
+
+    buffer.begin_undo_group({0, 0, 0});
+    buffer.insert(Cursor{0, 0, 0}, std::string("a"));
+    buffer.insert(Cursor{1, 0, 0}, std::string("b"));
+    buffer.insert(Cursor{0, 0, 0}, std::string("c"));
+    buffer.end_undo_group();
+    const auto edited = rows_of(buffer);
+
+    buffer.undo();
+    if (rows_of(buffer) != original) {
+        std::printf("undo left row 0 as \"%s\"\n", buffer.get_line(0).c_str());
+        return false;
+    }
+    buffer.redo();
+    if (rows_of(buffer) != edited) {
+        std::printf("redo left row 0 as \"%s\"\n", buffer.get_line(0).c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::string path = argc > 1 ? argv[1] : "undo_check.txt";
+    const bool ok = same_row_twice(path);
+    std::remove(path.c_str());
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}